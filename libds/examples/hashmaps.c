@@ -24,14 +24,57 @@ char* name_tostring(void* vname)
     return (char*) vname;
 }
 
-int32_t namecmp(void* vk1, void* vk2)
+/* A key of the map and its value, looked up once so that sorting by value
+ * doesn't look it up again on every comparison. */
+struct keyval {
+    struct DSHashKey *key;
+    char *name;
+};
+
+/* Compares pairs by their names. 'vorder' points to 1 for ascending order
+ * and to -1 for descending order. */
+int32_t namecmp(void* vkv1, void* vkv2, void* vorder)
 {
-    char *val1, *val2;
+    struct keyval *kv1, *kv2;
+
+    kv1 = (struct keyval *) vkv1;
+    kv2 = (struct keyval *) vkv2;
 
-    val1 = ds_hashmap_get_key((struct DSHashKey *) vk1);
-    val2 = ds_hashmap_get_key((struct DSHashKey *) vk2);
+    return *(int32_t *) vorder * strcmp(kv1->name, kv2->name);
+}
+
+void print_keyval(void* vkv)
+{
+    struct keyval *kv;
 
-    return strcmp((char*) val1, (char*) val2);
+    kv = (struct keyval *) vkv;
+    if (kv->key->keytype == DS_HASHMAP_KEY_STRING)
+        printf("(%s, %s)\n", kv->key->key.s, kv->name);
+    else
+        printf("(%d, %s)\n", kv->key->key.i, kv->name);
+}
+
+/* Prints the map's keys and values ordered by value, without reordering
+ * the map itself. */
+void print_by_name(struct DSHashMap *hash, int32_t order)
+{
+    struct DSVector *pairs;
+    struct keyval *kvs;
+    size_t i;
+
+    kvs = malloc(hash->keys.size * sizeof(*kvs));
+    pairs = ds_vector_create_capacity(hash->keys.size);
+    for (i = 0; i < hash->keys.size; ++i) {
+        kvs[i].key = ds_vector_get(&hash->keys, i);
+        kvs[i].name = ds_hashmap_get_key(kvs[i].key);
+        ds_vector_append(pairs, &kvs[i]);
+    }
+
+    ds_vector_sort_r(pairs, namecmp, &order);
+    ds_vector_map(pairs, print_keyval);
+
+    ds_vector_free_no_data(pairs);
+    free(kvs);
 }
 
 int
@@ -59,10 +102,11 @@ main()
     printf("\nKEYS--------\n");
     ds_hashmap_print_keyvals(hash, name_tostring);
 
-    ds_hashmap_sort_by(hash, namecmp);
+    printf("\nBY NAME-----\n");
+    print_by_name(hash, 1);
 
-    printf("\nKEYS--------\n");
-    ds_hashmap_print_keyvals(hash, name_tostring);
+    printf("\nBY NAME, DESCENDING\n");
+    print_by_name(hash, -1);
 
     ds_hashmap_remove_str(hash, "booger", false, false);
     ds_hashmap_remove_int(hash, 12344, false);
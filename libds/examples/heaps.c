@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds.h"
+
+#define NUM_NAMES 12
+char* names[] = {
+    "andrew", "bob", "sally", "billy", "kaitlyn", "springsteen",
+    "cauchy", "plato", "darlene", "jenny", "lauren", "barry"
+};
+
+int32_t namecmp(void *vname1, void *vname2)
+{
+    return strcmp((char*) vname1, (char*) vname2);
+}
+
+int32_t lencmp(void *vname1, void *vname2)
+{
+    return (int32_t) strlen((char*) vname1) - (int32_t) strlen((char*) vname2);
+}
+
+int
+main()
+{
+    struct DSHeap *heap, *top;
+    struct DSVector *vec;
+    char *name;
+    int i;
+
+    /* a 4-ary heap built from an existing vector in linear time */
+    vec = ds_vector_create();
+    for (i = 0; i < NUM_NAMES; ++i)
+        ds_vector_append(vec, names[i]);
+
+    heap = ds_heap_create_from(vec, namecmp, 4);
+    ds_heap_push(heap, "aaron");
+
+    printf("Peek: %s\n", (char*) ds_heap_peek(heap));
+    printf("Replaced: %s\n", (char*) ds_heap_replace_top(heap, "zed"));
+
+    while (NULL != (name = ds_heap_pop(heap)))
+        printf("%s\n", name);
+
+    printf("----------------------\n");
+
+    /* keep only the 3 longest names */
+    top = ds_heap_create_top(lencmp, 3, DS_HEAP_ARITY);
+    for (i = 0; i < NUM_NAMES; ++i)
+        ds_heap_push(top, names[i]);
+
+    printf("Size: %lu\n", (unsigned long) ds_heap_size(top));
+    while (NULL != (name = ds_heap_pop(top)))
+        printf("%s\n", name);
+
+    ds_heap_free_no_data(heap);
+    ds_heap_free_no_data(top);
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds.h"
+
+struct person {
+    char *name;
+    int age;
+
+    /* a person can be in a queue and a team at the same time */
+    struct DSIListLink queue;
+    struct DSIListLink team;
+};
+
+const int NUM_PEOPLE = 5;
+char* names[] = { "springsteen", "andrew", "plato", "kaitlyn", "cauchy" };
+int ages[] = { 67, 29, 80, 27, 67 };
+
+void print_person(void* vperson)
+{
+    struct person *p;
+
+    p = (struct person*) vperson;
+    printf("%s (%d)\n", p->name, p->age);
+}
+
+int32_t by_age(void *data1, void *data2)
+{
+    return ((struct person*) data1)->age - ((struct person*) data2)->age;
+}
+
+int
+main()
+{
+    struct DSIList queue, team;
+    struct DSIListLink *link;
+    struct person people[5];
+    int i;
+
+    ds_ilist_init(&queue, offsetof(struct person, queue));
+    ds_ilist_init(&team, offsetof(struct person, team));
+
+    for (i = 0; i < NUM_PEOPLE; ++i) {
+        people[i].name = names[i];
+        people[i].age = ages[i];
+
+        ds_ilist_append(&queue, &people[i].queue);
+        if (people[i].age > 50)
+            ds_ilist_prepend(&team, &people[i].team);
+    }
+
+    printf("length: %lu\n", (unsigned long) queue.length);
+    ds_ilist_map(&queue, print_person);
+
+    printf("--------\n");
+
+    for (link = team.first; link != NULL; link = link->next)
+        print_person(DS_ILIST_ENTRY(link, struct person, team));
+
+    printf("--------\n");
+
+    /* the sort is stable: springsteen stays ahead of cauchy */
+    ds_ilist_sort(&queue, by_age);
+    ds_ilist_map(&queue, print_person);
+
+    printf("--------\n");
+
+    /* move the last two to the front, and drop the youngest */
+    ds_ilist_splice(&queue, NULL, &queue, queue.last->prev, queue.last);
+    ds_ilist_remove(&queue, queue.first->next->next);
+    for (link = queue.last; link != NULL; link = link->prev)
+        print_person(DS_ILIST_ENTRY(link, struct person, queue));
+
+    return 0;
+}
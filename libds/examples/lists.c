@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,8 +24,9 @@ int32_t mycmp(void *data1, void *data2)
 int
 main()
 {
-    struct DSLinkedList *lst, *lstcopy;
-    struct DSListNode *node;
+    struct DSLinkedList *lst, *lstcopy, *rest;
+    struct DSListNode *node, *after;
+    struct DSListIter iter;
     int i;
 
     lst = ds_list_create();
@@ -32,17 +34,19 @@ main()
     for (i = 0; i < NUM_NAMES; ++i)
         ds_list_append(lst, names[i]);
 
-    printf("length: %d\n", lst->length);
+    printf("length: %lu\n", (unsigned long) lst->length);
     ds_list_map(lst, print_name);
 
-    for (node = lst->first; node; node = node->next) {
+    ds_list_iter_begin(lst, &iter, false);
+    while (NULL != (node = ds_list_iter_next(&iter))) {
         char* name;
 
         name = (char*) node->data;
 
         if (strcmp(name, "cauchy") == 0) {
-            ds_list_remove(lst, node);
-            ds_list_insert(lst, node->next, name);
+            after = ds_list_next(node);
+            ds_list_iter_remove(lst, &iter);
+            ds_list_insert(lst, after, name);
             break;
         }
     }
@@ -53,6 +57,26 @@ main()
 
     printf("--------\n");
 
+    ds_list_iter_begin(lst, &iter, true);
+    while (NULL != (node = ds_list_iter_next(&iter)))
+        print_name(node->data);
+
+    printf("--------\n");
+
+    /* Insert in the middle, and walk backwards: every node must be the
+     * one before the node visited just before it. */
+    ds_list_insert(lst, lst->first, "newton");
+    after = NULL;
+    ds_list_iter_begin(lst, &iter, true);
+    while (NULL != (node = ds_list_iter_next(&iter))) {
+        assert(ds_list_next(node) == after);
+        after = node;
+        print_name(node->data);
+    }
+    assert(after == lst->first);
+
+    printf("--------\n");
+
     lstcopy = ds_list_copy(lst);
     ds_list_sort(lst, mycmp);
 
@@ -60,6 +84,16 @@ main()
     printf("########\n");
     ds_list_map(lstcopy, print_name);
 
+    printf("--------\n");
+
+    /* rotate the sorted list: move its first two names to the end */
+    rest = ds_list_split_at(lst, ds_list_next(ds_list_next(lst->first)));
+    ds_list_concat(rest, lst);
+    ds_list_map(rest, print_name);
+    printf("length: %lu + %lu\n",
+           (unsigned long) rest->length, (unsigned long) lst->length);
+
+    ds_list_free_no_data(rest);
     ds_list_free_no_data(lstcopy);
     ds_list_free_no_data(lst);
 
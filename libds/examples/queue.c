@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -31,6 +32,17 @@ static int num_producers = 1;
  * CPU available. */
 static int num_consumers = 0;
 
+/* The number of producer threads in the select example, each with a queue
+ * of its own, and the number of items each one sends. */
+#define SELECT_PRODUCERS 4
+#define SELECT_ITEMS 1000
+
+/* The number of times the close race is run, and the number of producer
+ * and consumer threads racing in each. */
+#define RACE_ROUNDS 200
+#define RACE_PRODUCERS 4
+#define RACE_CONSUMERS 2
+
 /* End user configurable parameters. */
 
 /* The number of logical CPUs. If no CPUs are detected, this is set to 1.
@@ -53,6 +65,32 @@ static struct job job_create(int id,
 /* Computes the first 1000 prime numbers `JOBS` times sequentially. */
 static void sequential();
 
+/* A producer thread for the select example. It sends the integers from 1 to
+ * `SELECT_ITEMS` to its own queue, and closes it. */
+static void * select_producer(void *data);
+
+/* Starts `SELECT_PRODUCERS` producers, and sums up everything they send
+ * in a single consumer, with `ds_queue_select_get`. */
+static void select_example();
+
+/* Checks, in a single thread, what the puts and gets that can fail return
+ * when a queue is full, empty, slow or closed. */
+static void result_codes();
+
+/* A producer thread for the close race. It puts incrementing integers,
+ * in turn with `ds_queue_try_put`, `ds_queue_put_timeout` and
+ * `ds_queue_put`, until the queue is closed, and sums up those that were
+ * put. */
+static void * race_producer(void *data);
+
+/* A consumer thread for the close race. It sums up every integer it
+ * gets, until the queue is closed and empty. */
+static void * race_consumer(void *data);
+
+/* Closes a queue while producers are still putting into it, and checks
+ * that every value a put reported as added is gotten by a consumer. */
+static void close_race();
+
 /* Calculates the first `limit` prime numbers. */
 static int calc_primes(int limit);
 
@@ -159,9 +197,109 @@ int main(void)
     ds_queue_free(job_queue);
     ds_queue_free(results_queue);
 
+    select_example();
+    result_codes();
+    close_race();
+
     return 0;
 }
 
+void
+result_codes()
+{
+    struct DSQueue *queue;
+    int a = 1, b = 2;
+    void *item;
+
+    queue = ds_queue_create(1);
+
+    /* An empty queue: nothing to get, now or within a millisecond. */
+    assert(DS_QUEUE_EMPTY == ds_queue_try_get(queue, &item));
+    assert(DS_QUEUE_TIMEOUT == ds_queue_get_timeout(queue, &item, 1000000));
+
+    /* A full queue: no room to put, now or within a millisecond. */
+    assert(DS_QUEUE_OK == ds_queue_put(queue, &a));
+    assert(DS_QUEUE_FULL == ds_queue_try_put(queue, &b));
+    assert(DS_QUEUE_TIMEOUT == ds_queue_put_timeout(queue, &b, 1000000));
+
+    /* A closed queue takes nothing new, but still gives what it has. */
+    ds_queue_close(queue);
+    assert(DS_QUEUE_CLOSED == ds_queue_put(queue, &b));
+    assert(DS_QUEUE_CLOSED == ds_queue_try_put(queue, &b));
+    assert(DS_QUEUE_CLOSED == ds_queue_put_timeout(queue, &b, 1000000));
+    assert(DS_QUEUE_OK == ds_queue_try_get(queue, &item));
+    assert(item == &a);
+
+    /* Once it is also empty, gets fail at once, even with a timeout. */
+    assert(DS_QUEUE_CLOSED == ds_queue_try_get(queue, &item));
+    assert(DS_QUEUE_CLOSED == ds_queue_get_timeout(queue, &item,
+                                                   DS_QUEUE_FOREVER));
+    assert(NULL == ds_queue_get(queue));
+
+    ds_queue_free(queue);
+    printf("Result codes: ok\n");
+}
+
+void
+select_example()
+{
+    struct DSQueue *queues[SELECT_PRODUCERS], *open[SELECT_PRODUCERS];
+    pthread_t producers[SELECT_PRODUCERS];
+    size_t i, n;
+    void *item;
+    long total, expected;
+
+    /* Small queues, so that the producers are often blocked on them. */
+    for (i = 0; i < SELECT_PRODUCERS; i++) {
+        queues[i] = ds_queue_create(2);
+        open[i] = queues[i];
+        pthread_create(&(producers[i]), NULL, select_producer,
+                       (void*) queues[i]);
+    }
+
+    /* Serve every queue from this one thread. A queue that is closed and
+     * empty is taken out of `open`, and it is done once they all are. */
+    total = 0;
+    n = SELECT_PRODUCERS;
+    while (n > 0) {
+        if (DS_QUEUE_OK == ds_queue_select_get(open, n, &i, &item,
+                                               DS_QUEUE_FOREVER)) {
+            total += *(int*) item;
+            free(item);
+        } else {
+            open[i] = open[--n];
+        }
+    }
+
+    for (i = 0; i < SELECT_PRODUCERS; i++) {
+        assert(0 == pthread_join(producers[i], NULL));
+        ds_queue_free(queues[i]);
+    }
+
+    /* Each producer sent 1 + 2 + ... + SELECT_ITEMS. */
+    expected = (long) SELECT_PRODUCERS * SELECT_ITEMS * (SELECT_ITEMS + 1) / 2;
+    printf("Select total: %ld (expected %ld)\n", total, expected);
+    assert(total == expected);
+}
+
+void *
+select_producer(void *data)
+{
+    struct DSQueue *queue;
+    int i;
+    int *item;
+
+    queue = (struct DSQueue *) data;
+    for (i = 1; i <= SELECT_ITEMS; i++) {
+        assert(item = malloc(sizeof(*item)));
+        *item = i;
+        assert(DS_QUEUE_OK == ds_queue_put(queue, item));
+    }
+    ds_queue_close(queue);
+
+    return NULL;
+}
+
 void *
 producer(void *data)
 {
@@ -230,6 +368,114 @@ job_create(int id, struct DSQueue *job_queue, struct DSQueue *results_queue)
     return job;
 }
 
+/* The state shared by one thread of the close race and the main thread. */
+struct race {
+    struct DSQueue *queue;
+    long sum;
+};
+
+void
+close_race()
+{
+    struct race producers[RACE_PRODUCERS], consumers[RACE_CONSUMERS];
+    pthread_t prod_threads[RACE_PRODUCERS], cons_threads[RACE_CONSUMERS];
+    struct DSQueue *queue;
+    long put, gotten;
+    int round, i;
+
+    for (round = 0; round < RACE_ROUNDS; round++) {
+        /* Every other round uses an unbounded queue, which never fills. */
+        if (round % 2 == 0)
+            queue = ds_queue_create(4);
+        else
+            queue = ds_queue_create_unbounded(3);
+
+        for (i = 0; i < RACE_PRODUCERS; i++) {
+            producers[i].queue = queue;
+            producers[i].sum = 0;
+            pthread_create(&(prod_threads[i]), NULL, race_producer,
+                           (void*) &(producers[i]));
+        }
+        for (i = 0; i < RACE_CONSUMERS; i++) {
+            consumers[i].queue = queue;
+            consumers[i].sum = 0;
+            pthread_create(&(cons_threads[i]), NULL, race_consumer,
+                           (void*) &(consumers[i]));
+        }
+
+        /* Give the threads a varying head start before the close. */
+        for (i = 0; i < round % 20; i++)
+            sched_yield();
+        ds_queue_close(queue);
+
+        put = gotten = 0;
+        for (i = 0; i < RACE_PRODUCERS; i++) {
+            assert(0 == pthread_join(prod_threads[i], NULL));
+            put += producers[i].sum;
+        }
+        for (i = 0; i < RACE_CONSUMERS; i++) {
+            assert(0 == pthread_join(cons_threads[i], NULL));
+            gotten += consumers[i].sum;
+        }
+
+        if (put != gotten) {
+            printf("Close race %d: put %ld, but got %ld\n",
+                   round, put, gotten);
+            assert(put == gotten);
+        }
+        ds_queue_free(queue);
+    }
+    printf("Close race: ok\n");
+}
+
+void *
+race_producer(void *data)
+{
+    struct race *race;
+    int i, status;
+    int *item;
+
+    race = (struct race *) data;
+    for (i = 1; ; i++) {
+        assert(item = malloc(sizeof(*item)));
+        *item = i;
+
+        /* A full queue or a timeout just means trying again. */
+        do {
+            if (i % 3 == 0)
+                status = ds_queue_try_put(race->queue, item);
+            else if (i % 3 == 1)
+                status = ds_queue_put_timeout(race->queue, item, 100000);
+            else
+                status = ds_queue_put(race->queue, item);
+        } while (status == DS_QUEUE_FULL || status == DS_QUEUE_TIMEOUT);
+
+        if (status == DS_QUEUE_CLOSED) {
+            free(item);
+            break;
+        }
+        assert(status == DS_QUEUE_OK);
+        race->sum += i;
+    }
+
+    return NULL;
+}
+
+void *
+race_consumer(void *data)
+{
+    struct race *race;
+    int *item;
+
+    race = (struct race *) data;
+    while (NULL != (item = (int*) ds_queue_get(race->queue))) {
+        race->sum += *item;
+        free(item);
+    }
+
+    return NULL;
+}
+
 /* Adapted from http://goo.gl/7PxJt */
 int
 calc_primes(int limit) {
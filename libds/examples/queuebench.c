@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "ds.h"
+
+/* A contention benchmark for DSQueue: many producers and consumers share
+ * one small queue, so that threads constantly find it full or empty. It
+ * reports the throughput and the number of context switches the process
+ * went through, which is where a thundering herd shows. It runs with
+ * threads spinning and yielding before they block, with them blocking at
+ * once, and on an unbounded queue. */
+
+/* The number of producer threads, and of consumer threads. */
+#define THREADS 16
+
+/* The number of items each producer sends. */
+#define ITEMS 50000
+
+/* The capacity of the queue. Small, so that the queue is often full. */
+#define BUFFER 16
+
+static void *
+producer(void *data)
+{
+    struct DSQueue *queue;
+    long i;
+
+    queue = (struct DSQueue *) data;
+    for (i = 1; i <= ITEMS; i++)
+        ds_queue_put(queue, (void*) i);
+
+    return NULL;
+}
+
+static void *
+consumer(void *data)
+{
+    struct DSQueue *queue;
+    long count;
+
+    queue = (struct DSQueue *) data;
+    count = 0;
+    while (NULL != ds_queue_get(queue))
+        count++;
+
+    return (void*) count;
+}
+
+/* Runs the benchmark once on 'queue', prints the results and frees the
+ * queue. */
+static void
+run(const char *name, struct DSQueue *queue)
+{
+    pthread_t producers[THREADS], consumers[THREADS];
+    struct timespec start, end;
+    struct rusage before, after;
+    double secs;
+    long total, voluntary, switches;
+    void *count;
+    int i;
+
+    /* On Linux, RUSAGE_SELF covers every thread of the process. */
+    getrusage(RUSAGE_SELF, &before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < THREADS; i++) {
+        pthread_create(&consumers[i], NULL, consumer, queue);
+        pthread_create(&producers[i], NULL, producer, queue);
+    }
+
+    for (i = 0; i < THREADS; i++)
+        pthread_join(producers[i], NULL);
+    ds_queue_close(queue);
+
+    total = 0;
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(consumers[i], &count);
+        total += (long) count;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &after);
+
+    voluntary = after.ru_nvcsw - before.ru_nvcsw;
+    switches = voluntary + after.ru_nivcsw - before.ru_nivcsw;
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s:\n", name);
+    printf("  Total consumed: %ld of %ld\n", total, (long) THREADS * ITEMS);
+    printf("  %.2f million items per second\n", total / secs / 1e6);
+    printf("  %ld context switches (%ld voluntary), %.3f per item\n",
+           switches, voluntary, (double) switches / total);
+
+    ds_queue_free(queue);
+}
+
+int
+main(void)
+{
+    struct DSQueue *queue;
+
+    printf("%d producers, %d consumers, capacity %d\n",
+           THREADS, THREADS, BUFFER);
+
+    run("Spinning and yielding before blocking (the default)",
+        ds_queue_create(BUFFER));
+
+    queue = ds_queue_create(BUFFER);
+    ds_queue_set_backoff(queue, 0, 0);
+    run("Blocking at once", queue);
+
+    /* Producers never wait here, only consumers. */
+    run("Unbounded, in segments of the same capacity",
+        ds_queue_create_unbounded(BUFFER));
+
+    return 0;
+}
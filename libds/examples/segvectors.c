@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ds.h"
+
+void print_number(void *vnum)
+{
+    printf("%d\n", *(int*) vnum);
+}
+
+int
+main()
+{
+    struct DSSegVector *vec;
+    void **first;
+    size_t i;
+    int *num;
+
+    /* use tiny chunks of 4 elements so that growing is easy to see */
+    vec = ds_segvector_create_shift(2);
+    first = NULL;
+
+    for (i = 0; i < 10; ++i) {
+        num = malloc(sizeof(*num));
+        *num = (int) (i * i);
+        ds_segvector_append(vec, num);
+
+        if (i == 0)
+            first = ds_segvector_at(vec, 0);
+    }
+
+    /* the first element never moved while the vector grew */
+    printf("Size: %lu, Chunks: %lu, First element moved: %s\n",
+           (unsigned long) vec->size, (unsigned long) vec->nchunks,
+           first == ds_segvector_at(vec, 0) ? "no" : "yes");
+
+    ds_segvector_map(vec, print_number);
+    printf("----------------------\n");
+
+    for (i = 0; i < 5; ++i)
+        free(ds_segvector_pop(vec));
+    ds_segvector_shrink_to_fit(vec);
+
+    printf("Size: %lu, Chunks: %lu\n",
+           (unsigned long) vec->size, (unsigned long) vec->nchunks);
+    for (i = 0; i < vec->size; ++i)
+        print_number(DS_SEGVECTOR_AT(vec, i));
+
+    ds_segvector_free(vec);
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds.h"
+
+#define NUM_NAMES 12
+char* names[] = {
+    "andrew", "bob", "sally", "billy", "kaitlyn", "springsteen",
+    "cauchy", "plato", "darlene", "jenny", "lauren", "barry"
+};
+
+#define NUM_THREADS 4
+#define PER_THREAD 10000
+
+struct DSSkipList *shared;
+
+int32_t namecmp(void *vname1, void *vname2)
+{
+    return strcmp((char*) vname1, (char*) vname2);
+}
+
+int32_t numcmp(void *vnum1, void *vnum2)
+{
+    long num1 = (long) vnum1, num2 = (long) vnum2;
+
+    return num1 < num2 ? -1 : num1 > num2;
+}
+
+void print_name(void *vname)
+{
+    printf("%s\n", (char*) vname);
+}
+
+/* inserts its share of the numbers, then removes the odd ones */
+void *worker(void *varg)
+{
+    long first, i;
+
+    first = (long) varg * PER_THREAD;
+    for (i = first; i < first + PER_THREAD; ++i)
+        ds_skiplist_insert(shared, (void*) i);
+    for (i = first + 1; i < first + PER_THREAD; i += 2)
+        ds_skiplist_remove(shared, (void*) i);
+
+    return NULL;
+}
+
+int
+main()
+{
+    struct DSSkipList *sl;
+    struct DSSkipNode *node;
+    pthread_t threads[NUM_THREADS];
+    long i, prev;
+    bool sorted;
+
+    sl = ds_skiplist_create(namecmp);
+    for (i = 0; i < NUM_NAMES; ++i)
+        ds_skiplist_insert(sl, names[i]);
+
+    printf("length: %lu\n", (unsigned long) sl->length);
+    printf("find plato: %s\n", (char*) ds_skiplist_find(sl, "plato"));
+    printf("find zed: %s\n",
+           ds_skiplist_find(sl, "zed") == NULL ? "not found" : "found");
+    printf("removed: %s\n", (char*) ds_skiplist_remove(sl, "kaitlyn"));
+
+    printf("--------\n");
+    ds_skiplist_range(sl, "b", "d", print_name);
+
+    printf("--------\n");
+    for (node = ds_skiplist_lower_bound(sl, "l"); node != NULL;
+         node = ds_skiplist_next(sl, node))
+        print_name(node->data);
+
+    ds_skiplist_free_no_data(sl);
+
+    /* several threads at once on a concurrent list */
+    shared = ds_skiplist_create_concurrent(numcmp, NULL);
+    for (i = 0; i < NUM_THREADS; ++i)
+        pthread_create(&threads[i], NULL, worker, (void*) i);
+    for (i = 0; i < NUM_THREADS; ++i)
+        pthread_join(threads[i], NULL);
+
+    sorted = true;
+    prev = -1;
+    for (node = ds_skiplist_first(shared); node != NULL;
+         node = ds_skiplist_next(shared, node)) {
+        sorted = sorted && (long) node->data == prev + 2 - (prev < 0);
+        prev = (long) node->data;
+    }
+
+    printf("--------\n");
+    printf("concurrent length: %lu, sorted evens: %s\n",
+           (unsigned long) shared->length, sorted ? "yes" : "no");
+
+    ds_skiplist_free_no_data(shared);
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ds.h"
+
+/* The number of items to send from the producer to the consumer. */
+#define ITEMS 10000000
+
+/* The capacity of the queue. */
+#define BUFFER 1024
+
+/* The producer thread. It sends the numbers 1 to ITEMS, then closes the
+ * queue. */
+static void *
+producer(void *data)
+{
+    struct DSSpscQueue *queue;
+    long i;
+
+    queue = (struct DSSpscQueue *) data;
+    for (i = 1; i <= ITEMS; i++)
+        if (DS_QUEUE_OK != ds_spsc_queue_put(queue, (void*) i)) {
+            fprintf(stderr, "put failed on an open queue\n");
+            exit(1);
+        }
+    ds_spsc_queue_close(queue);
+
+    if (DS_QUEUE_CLOSED != ds_spsc_queue_put(queue, (void*) i)) {
+        fprintf(stderr, "put did not fail on a closed queue\n");
+        exit(1);
+    }
+
+    return NULL;
+}
+
+int
+main(void)
+{
+    struct DSSpscQueue *queue;
+    pthread_t thread;
+    struct timespec start, end;
+    double secs;
+    long count, sum;
+    void *item;
+
+    queue = ds_spsc_queue_create(BUFFER);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&thread, NULL, producer, queue);
+
+    /* The main thread is the consumer. */
+    count = 0;
+    sum = 0;
+    while (NULL != (item = ds_spsc_queue_get(queue))) {
+        count++;
+        sum += (long) item;
+    }
+
+    pthread_join(thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Capacity: %lu\n", (unsigned long) ds_spsc_queue_capacity(queue));
+    printf("Total consumed: %ld (sum %s)\n", count,
+           sum == (long) ITEMS * (ITEMS + 1) / 2 ? "correct" : "WRONG");
+    printf("%.1f million items per second\n", count / secs / 1e6);
+
+    ds_spsc_queue_free(queue);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds.h"
+
+const int NUM_NAMES = 5;
+char* names[] = { "springsteen", "andrew", "plato", "kaitlyn", "cauchy" };
+
+void print_name(void* vname)
+{
+    char* name;
+
+    name = (char*) vname;
+    printf("%s (%d)\n", name, (uint32_t)strlen(name));
+}
+
+int32_t mycmp(void *data1, void *data2)
+{
+    return strcmp((char*) data1, (char*) data2);
+}
+
+int
+main()
+{
+    struct DSUnrolledList *lst, *lstcopy;
+    struct DSUListIter iter;
+    void **item;
+    long i, sum;
+
+    lst = ds_ulist_create();
+
+    for (i = 0; i < NUM_NAMES; ++i)
+        ds_ulist_append(lst, names[i]);
+
+    printf("length: %lu\n", (unsigned long) lst->length);
+    ds_ulist_map(lst, print_name);
+
+    /* move "plato" to the end and put "euler" after "andrew" */
+    ds_ulist_iter_begin(lst, &iter, false);
+    while (NULL != (item = ds_ulist_iter_next(&iter))) {
+        if (strcmp((char*) *item, "plato") == 0)
+            ds_ulist_iter_remove(lst, &iter);
+        else if (strcmp((char*) *item, "andrew") == 0)
+            ds_ulist_iter_insert(lst, &iter, "euler");
+    }
+    ds_ulist_append(lst, "plato");
+
+    printf("--------\n");
+
+    ds_ulist_map(lst, print_name);
+
+    printf("--------\n");
+
+    ds_ulist_iter_begin(lst, &iter, true);
+    while (NULL != (item = ds_ulist_iter_next(&iter)))
+        print_name(*item);
+
+    printf("--------\n");
+
+    lstcopy = ds_ulist_copy(lst);
+    ds_ulist_sort(lst, mycmp);
+
+    ds_ulist_map(lst, print_name);
+    printf("########\n");
+    ds_ulist_map(lstcopy, print_name);
+
+    ds_ulist_free_no_data(lstcopy);
+    ds_ulist_free_no_data(lst);
+
+    /* a longer list spans many nodes; drop the odd numbers */
+    lst = ds_ulist_create();
+    for (i = 0; i < 1000; ++i)
+        ds_ulist_append(lst, (void*) i);
+
+    ds_ulist_iter_begin(lst, &iter, false);
+    while (NULL != (item = ds_ulist_iter_next(&iter)))
+        if ((long) *item % 2 == 1)
+            ds_ulist_iter_remove(lst, &iter);
+
+    sum = 0;
+    ds_ulist_iter_begin(lst, &iter, false);
+    while (NULL != (item = ds_ulist_iter_next(&iter)))
+        sum += (long) *item;
+
+    printf("--------\n");
+    printf("length: %lu, sum: %ld\n", (unsigned long) lst->length, sum);
+
+    ds_ulist_free_no_data(lst);
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,6 +7,10 @@
 #include "ds.h"
 
 #define NUM_NAMES 22
+
+/* The few-distinct-keys sorts: FEW_SIZE elements, at most FEW_KEYS keys. */
+#define FEW_SIZE 1000000
+#define FEW_KEYS 3
 char* names[] = {
     "andrew", "bob", "sally", "billy", "kaitlyn", "springsteen",
     "cauchy", "plato", "darlene", "jenny", "lauren", "barry",
@@ -41,20 +46,100 @@ int32_t namecmp(void* vname1, void* vname2)
     return stricmp((char*) vname1, (char*) vname2);
 }
 
+int32_t keycmp(void *a, void *b)
+{
+    uintptr_t x = (uintptr_t) a, y = (uintptr_t) b;
+
+    return x < y ? -1 : x > y;
+}
+
+int32_t keycmp_r(void *a, void *b, void *ctx)
+{
+    ++*(unsigned long*) ctx;
+    return keycmp(a, b);
+}
+
+/* Checks that 'vec' is sorted and still holds 'counts[k]' copies of k. */
+void check_keys(struct DSVector *vec, size_t *counts, size_t nkeys,
+                const char *what)
+{
+    size_t i, *seen;
+
+    seen = calloc(nkeys, sizeof(*seen));
+    for (i = 0; i < vec->size; ++i) {
+        if (i > 0 && keycmp(vec->data[i - 1], vec->data[i]) > 0) {
+            fprintf(stderr, "%s: out of order at %lu\n",
+                    what, (unsigned long) i);
+            exit(1);
+        }
+        ++seen[(uintptr_t) vec->data[i]];
+    }
+    for (i = 0; i < nkeys; ++i)
+        if (seen[i] != counts[i]) {
+            fprintf(stderr, "%s: lost elements of key %lu\n",
+                    what, (unsigned long) i);
+            exit(1);
+        }
+    free(seen);
+}
+
+/* Sorts large vectors with only a handful of distinct keys, which used to
+ * make the quicksort quadratic. */
+void few_keys(void)
+{
+    struct DSVector *vec;
+    size_t counts[FEW_KEYS], nkeys, i;
+    unsigned long compares;
+    uint32_t seed;
+
+    for (nkeys = 1; nkeys <= FEW_KEYS; ++nkeys) {
+        vec = ds_vector_create_capacity(FEW_SIZE);
+        memset(counts, 0, sizeof(counts));
+        seed = 2463534242UL;
+        for (i = 0; i < FEW_SIZE; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            ++counts[seed % nkeys];
+            ds_vector_append(vec, (void*) (uintptr_t) (seed % nkeys));
+        }
+
+        ds_vector_sort_parallel(vec, keycmp, 4);
+        check_keys(vec, counts, nkeys, "ds_vector_sort_parallel");
+
+        /* already sorted input */
+        ds_vector_sort(vec, keycmp);
+        check_keys(vec, counts, nkeys, "ds_vector_sort");
+
+        /* reversed input */
+        for (i = 0; i < FEW_SIZE / 2; ++i)
+            ds_vector_swap(vec, i, FEW_SIZE - 1 - i);
+        compares = 0;
+        ds_vector_sort_r(vec, keycmp_r, &compares);
+        check_keys(vec, counts, nkeys, "ds_vector_sort_r");
+
+        printf("%lu keys: sorted %d elements, %lu comparisons\n",
+               (unsigned long) nkeys, FEW_SIZE, compares);
+        ds_vector_free_no_data(vec);
+    }
+}
+
 int
 main()
 {
     struct DSVector *vec, *vec2;
-    int32_t i;
+    size_t i;
 
     vec = ds_vector_create_capacity(10);
 
-    printf("Size: %d, Capacity: %d\n", vec->size, vec->capacity);
+    printf("Size: %lu, Capacity: %lu\n",
+           (unsigned long) vec->size, (unsigned long) vec->capacity);
 
     for (i = 0; strcmp(names[i], "SENTINEL") != 0; ++i)
         ds_vector_append(vec, names[i]);
 
-    printf("Size: %d, Capacity: %d\n", vec->size, vec->capacity);
+    printf("Size: %lu, Capacity: %lu\n",
+           (unsigned long) vec->size, (unsigned long) vec->capacity);
 
     ds_vector_insert(vec, "DAVID", vec->size - 10);
     /* ds_vector_remove(vec, ds_vector_find(vec, "DAVID", namecmp)); */
@@ -62,8 +147,10 @@ main()
     vec2 = ds_vector_copy(vec);
     ds_vector_sort(vec, namecmp);
 
-    printf("Size: %d, Capacity: %d\n", vec->size, vec->capacity);
-    printf("Size: %d, Capacity: %d\n", vec2->size, vec2->capacity);
+    printf("Size: %lu, Capacity: %lu\n",
+           (unsigned long) vec->size, (unsigned long) vec->capacity);
+    printf("Size: %lu, Capacity: %lu\n",
+           (unsigned long) vec2->size, (unsigned long) vec2->capacity);
 
     ds_vector_map(vec, print_name);
     printf("----------------------\n");
@@ -72,6 +159,8 @@ main()
     ds_vector_free_no_data(vec);
     ds_vector_free_no_data(vec2);
 
+    few_keys();
+
     return 0;
 }
 
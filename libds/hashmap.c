@@ -38,12 +38,12 @@ struct DSHashMap *
 ds_hashmap_create()
 {
     struct DSHashMap *hash;
-    int32_t i;
+    size_t i;
 
     hash = malloc(sizeof(*hash));
     assert(hash);
 
-    hash->keys = ds_vector_create();
+    ds_vector_init(&hash->keys);
     hash->buckets = malloc(DS_HASHMAP_BUCKETS * sizeof(*hash->buckets));
     assert(hash->buckets);
 
@@ -57,7 +57,7 @@ void
 ds_hashmap_free(struct DSHashMap *hash, bool free_data, bool free_string_keys)
 {
     struct DSHashItem *item, *item2;
-    int32_t i;
+    size_t i;
 
     for (i = 0; i < DS_HASHMAP_BUCKETS; ++i) {
         item = hash->buckets[i];
@@ -76,7 +76,7 @@ ds_hashmap_free(struct DSHashMap *hash, bool free_data, bool free_string_keys)
         }
     }
 
-    ds_vector_free_no_data(hash->keys);
+    ds_vector_release(&hash->keys);
     free(hash->buckets);
     free(hash);
 }
@@ -156,7 +156,7 @@ ds_hashmap_put(struct DSHashMap *hash, void *data, char* skey, int32_t ikey,
     else
         last->next = item;
 
-    ds_vector_append(hash->keys, item->key);
+    ds_vector_append(&hash->keys, item->key);
 }
 
 void
@@ -186,7 +186,7 @@ ds_hashmap_remove(struct DSHashMap *hash, char *skey, int32_t ikey, int8_t type,
     last = NULL;
     while (item != NULL) {
         if (is_key_match(item->key, skey, ikey, type)) {
-            int32_t i;
+            size_t i;
 
             if (last == NULL)
                 hash->buckets[hashval] = NULL;
@@ -194,12 +194,12 @@ ds_hashmap_remove(struct DSHashMap *hash, char *skey, int32_t ikey, int8_t type,
                 last->next = item->next;
 
             /* find the key in the keys vector */
-            for (i = 0; i < hash->keys->size; ++i) {
+            for (i = 0; i < hash->keys.size; ++i) {
                 struct DSHashKey *k;
 
-                k = (struct DSHashKey*) ds_vector_get(hash->keys, i);
+                k = (struct DSHashKey*) ds_vector_get(&hash->keys, i);
                 if (is_key_match(k, skey, ikey, type)) {
-                    ds_vector_remove(hash->keys, i);
+                    ds_vector_remove(&hash->keys, i);
                     break;
                 }
             }
@@ -294,12 +294,12 @@ ds_hashmap_get_item(struct DSHashMap *hash, char *skey, int32_t ikey,
 void
 ds_hashmap_print_keys(struct DSHashMap *hash)
 {
-    int32_t i;
+    size_t i;
 
-    for (i = 0; i < hash->keys->size; ++i) {
+    for (i = 0; i < hash->keys.size; ++i) {
         struct DSHashKey *key;
 
-        key = ds_vector_get(hash->keys, i);
+        key = ds_vector_get(&hash->keys, i);
 
         switch(key->keytype) {
         case DS_HASHMAP_KEY_STRING:
@@ -315,12 +315,12 @@ ds_hashmap_print_keys(struct DSHashMap *hash)
 void
 ds_hashmap_print_keyvals(struct DSHashMap *hash, char* (tostring)(void*))
 {
-    int32_t i;
+    size_t i;
 
-    for (i = 0; i < hash->keys->size; ++i) {
+    for (i = 0; i < hash->keys.size; ++i) {
         struct DSHashKey *key;
 
-        key = ds_vector_get(hash->keys, i);
+        key = ds_vector_get(&hash->keys, i);
 
         switch(key->keytype) {
         case DS_HASHMAP_KEY_STRING:
@@ -344,7 +344,14 @@ ds_hashmap_sort_keys(struct DSHashMap *hash)
 void
 ds_hashmap_sort_by(struct DSHashMap *hash, int32_t (compare)(void*, void*))
 {
-    ds_vector_sort(hash->keys, compare);
+    ds_vector_sort(&hash->keys, compare);
+}
+
+void
+ds_hashmap_sort_by_r(struct DSHashMap *hash,
+                     int32_t (compare)(void*, void*, void*), void *ctx)
+{
+    ds_vector_sort_r(&hash->keys, compare, ctx);
 }
 
 /* A comparison function for sorting keys by name */
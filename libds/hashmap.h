@@ -3,12 +3,13 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "vector.h"
 
 /* The number of buckets to allocate */
-static const int32_t DS_HASHMAP_BUCKETS = 1000000;
+static const size_t DS_HASHMAP_BUCKETS = 1000000;
 
 /* key types */
 #define DS_HASHMAP_KEY_INT 1
@@ -17,7 +18,7 @@ static const int32_t DS_HASHMAP_BUCKETS = 1000000;
 struct DSHashMap {
     /* storing the keys isn't strictly necessary for a hash map, but it makes
      * iterating over the elements in a hash map much more efficient. */
-    struct DSVector *keys;
+    struct DSVector keys;
     struct DSHashItem **buckets;
 };
 
@@ -134,6 +135,17 @@ ds_hashmap_sort_keys(struct DSHashMap *hash);
 void
 ds_hashmap_sort_by(struct DSHashMap *hash, int32_t (compare)(void*, void*));
 
+/**
+ * Like ds_hashmap_sort_by, but 'ctx' is passed as the third argument to
+ * every call of 'compare', as in ds_vector_sort_r.
+ * To order by value, look every value up once (with ds_hashmap_get_key)
+ * and sort those instead, as examples/hashmaps.c does: looking values up
+ * in 'compare' costs two hash lookups per comparison.
+ */
+void
+ds_hashmap_sort_by_r(struct DSHashMap *hash,
+                     int32_t (compare)(void*, void*, void*), void *ctx);
+
 /**
  * Prints a list of key names/numbers for debugging purposes.
  */
@@ -0,0 +1,200 @@
+#include <stdlib.h>
+
+#include "heap.h"
+
+/* private helpers to restore the heap order around one element */
+static void
+ds_heap_sift_up(struct DSHeap *heap, size_t i);
+
+static void
+ds_heap_sift_down(struct DSHeap *heap, size_t i);
+
+struct DSHeap *
+ds_heap_create(int32_t (compare)(void*, void*))
+{
+    return ds_heap_create_arity(compare, DS_HEAP_ARITY);
+}
+
+struct DSHeap *
+ds_heap_create_arity(int32_t (compare)(void*, void*), size_t arity)
+{
+    return ds_heap_create_from(ds_vector_create(), compare, arity);
+}
+
+struct DSHeap *
+ds_heap_create_from(struct DSVector *vec, int32_t (compare)(void*, void*),
+                    size_t arity)
+{
+    struct DSHeap *heap;
+    size_t i;
+
+    assert(arity >= 2);
+
+    heap = malloc(sizeof(*heap));
+    assert(heap);
+
+    heap->vec = vec;
+    heap->compare = compare;
+    heap->arity = arity;
+    heap->limit = 0;
+
+    /* Floyd's heap construction: sift down every node that has children,
+     * starting from the last one. */
+    for (i = vec->size / arity + 1; i > 0; --i)
+        ds_heap_sift_down(heap, i - 1);
+
+    return heap;
+}
+
+struct DSHeap *
+ds_heap_create_top(int32_t (compare)(void*, void*), size_t k, size_t arity)
+{
+    struct DSHeap *heap;
+
+    assert(k > 0);
+
+    heap = ds_heap_create_from(ds_vector_create_capacity(k), compare, arity);
+    heap->limit = k;
+
+    return heap;
+}
+
+void
+ds_heap_free(struct DSHeap *heap)
+{
+    ds_vector_free(heap->vec);
+    free(heap);
+}
+
+void
+ds_heap_free_no_data(struct DSHeap *heap)
+{
+    ds_vector_free_no_data(heap->vec);
+    free(heap);
+}
+
+size_t
+ds_heap_size(struct DSHeap *heap)
+{
+    return heap->vec->size;
+}
+
+void *
+ds_heap_push(struct DSHeap *heap, void *data)
+{
+    if (heap->limit > 0 && heap->vec->size == heap->limit) {
+        /* not greater than anything we keep, so it doesn't make the cut */
+        if (heap->compare(data, heap->vec->data[0]) <= 0)
+            return data;
+
+        return ds_heap_replace_top(heap, data);
+    }
+
+    ds_vector_append(heap->vec, data);
+    ds_heap_sift_up(heap, heap->vec->size - 1);
+
+    return NULL;
+}
+
+void *
+ds_heap_pop(struct DSHeap *heap)
+{
+    void *top;
+
+    if (heap->vec->size == 0)
+        return NULL;
+
+    top = heap->vec->data[0];
+    heap->vec->data[0] = heap->vec->data[--heap->vec->size];
+    ds_heap_sift_down(heap, 0);
+
+    return top;
+}
+
+void *
+ds_heap_peek(struct DSHeap *heap)
+{
+    if (heap->vec->size == 0)
+        return NULL;
+
+    return heap->vec->data[0];
+}
+
+void *
+ds_heap_replace_top(struct DSHeap *heap, void *data)
+{
+    void *top;
+
+    if (heap->vec->size == 0) {
+        ds_heap_push(heap, data);
+        return NULL;
+    }
+
+    top = heap->vec->data[0];
+    heap->vec->data[0] = data;
+    ds_heap_sift_down(heap, 0);
+
+    return top;
+}
+
+/* Moves the element at i up until its parent is not greater. Instead of
+ * swapping at every level, parents are shifted down into the hole and the
+ * element is written once at the end. */
+static void
+ds_heap_sift_up(struct DSHeap *heap, size_t i)
+{
+    void **data, *item;
+    size_t parent;
+
+    data = heap->vec->data;
+    item = data[i];
+
+    while (i > 0) {
+        parent = (i - 1) / heap->arity;
+        if (heap->compare(item, data[parent]) >= 0)
+            break;
+
+        data[i] = data[parent];
+        i = parent;
+    }
+
+    data[i] = item;
+}
+
+/* Moves the element at i down until none of its children is smaller. */
+static void
+ds_heap_sift_down(struct DSHeap *heap, size_t i)
+{
+    void **data, *item;
+    size_t size, child, last, best;
+
+    data = heap->vec->data;
+    size = heap->vec->size;
+    if (i >= size)
+        return;
+
+    item = data[i];
+
+    for (;;) {
+        child = i * heap->arity + 1;
+        if (child >= size)
+            break;
+
+        last = child + heap->arity;
+        if (last > size)
+            last = size;
+
+        best = child;
+        for (++child; child < last; ++child)
+            if (heap->compare(data[child], data[best]) < 0)
+                best = child;
+
+        if (heap->compare(data[best], item) >= 0)
+            break;
+
+        data[i] = data[best];
+        i = best;
+    }
+
+    data[i] = item;
+}
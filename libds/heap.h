@@ -0,0 +1,120 @@
+#ifndef __LIBDS_HEAP_H__
+#define __LIBDS_HEAP_H__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+/* some private constants for heap tuning */
+static const size_t DS_HEAP_ARITY = 2;
+
+/**
+ * A DSHeap is a priority queue stored in a DSVector. The element at the
+ * top is always the smallest one according to 'compare', where compare
+ * is defined as for ds_vector_sort:
+ *      compare(a, b) < 0 when a < b
+ *      compare(a, b) = 0 when a = b
+ *      compare(a, b) > 0 when a > b
+ *
+ * Every node has 'arity' children. Wider nodes (e.g. 4) make the heap
+ * shallower and keep the children of a node in the same cache line, at
+ * the cost of more comparisons per level when popping.
+ */
+struct DSHeap {
+    /* The elements in heap order. vec->data[0] is the top. */
+    struct DSVector *vec;
+
+    int32_t (*compare)(void*, void*);
+    size_t arity;
+
+    /* When not 0, the heap is bounded and keeps at most 'limit' elements.
+     * See ds_heap_create_top. */
+    size_t limit;
+};
+
+/**
+ * Creates an empty binary heap.
+ * ds_heap_free or ds_heap_free_no_data will need to be called when done
+ * with the heap to avoid memory leaks.
+ */
+struct DSHeap *
+ds_heap_create(int32_t (compare)(void*, void*));
+
+/**
+ * Creates an empty heap where every node has 'arity' children.
+ */
+struct DSHeap *
+ds_heap_create_arity(int32_t (compare)(void*, void*), size_t arity);
+
+/**
+ * Creates a heap out of the elements already in 'vec' in O(n) time.
+ * The heap takes ownership of 'vec', which is reordered in place and is
+ * freed along with the heap.
+ */
+struct DSHeap *
+ds_heap_create_from(struct DSVector *vec, int32_t (compare)(void*, void*),
+                    size_t arity);
+
+/**
+ * Creates a bounded heap that keeps only the 'k' greatest elements pushed
+ * to it (the "top K"). The top of the heap is the smallest element that
+ * is kept, so it is the one evicted when a greater element is pushed.
+ * Every push runs in O(log k) time, no matter how many elements are seen.
+ */
+struct DSHeap *
+ds_heap_create_top(int32_t (compare)(void*, void*), size_t k, size_t arity);
+
+/**
+ * Free's a heap, its vector AND its data.
+ */
+void
+ds_heap_free(struct DSHeap *heap);
+
+/**
+ * Free's a heap and its vector. Data is NOT freed.
+ */
+void
+ds_heap_free_no_data(struct DSHeap *heap);
+
+/**
+ * Returns the number of elements in the heap.
+ */
+size_t
+ds_heap_size(struct DSHeap *heap);
+
+/**
+ * Adds an element to the heap in O(log n) time.
+ *
+ * Returns NULL, unless the heap is bounded and full. In that case the
+ * smallest of the kept elements and 'data' is dropped and returned, so
+ * that the caller can free it.
+ */
+void *
+ds_heap_push(struct DSHeap *heap, void *data);
+
+/**
+ * Removes and returns the top (smallest) element of the heap in O(log n)
+ * time. Returns NULL if the heap is empty.
+ */
+void *
+ds_heap_pop(struct DSHeap *heap);
+
+/**
+ * Returns the top (smallest) element of the heap without removing it.
+ * Returns NULL if the heap is empty.
+ */
+void *
+ds_heap_peek(struct DSHeap *heap);
+
+/**
+ * Replaces the top element of the heap with 'data' and returns the old
+ * top. This is a single O(log n) sift, and about twice as fast as a pop
+ * followed by a push. If the heap is empty, 'data' is pushed and NULL is
+ * returned.
+ */
+void *
+ds_heap_replace_top(struct DSHeap *heap, void *data);
+
+#endif
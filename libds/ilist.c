@@ -0,0 +1,326 @@
+#include <stdlib.h>
+
+#include "ilist.h"
+
+/* What a sort compares: the elements of 'lst', or, when 'by_member' is
+ * set, the pointers stored 'member_offset' bytes into them. */
+struct DSIListOrder {
+    struct DSIList *lst;
+    bool by_member;
+    size_t member_offset;
+    int32_t (*compare)(void*, void*);
+};
+
+/* private helper functions */
+static void *
+ds_ilist_entry(struct DSIList *lst, struct DSIListLink *link);
+
+static void
+ds_ilist_sort_order(struct DSIListOrder *order);
+
+static void *
+ds_ilist_sort_value(struct DSIListOrder *order, struct DSIListLink *link);
+
+static struct DSIListLink *
+ds_ilist_cut_run(struct DSIListOrder *order, struct DSIListLink *head,
+                 struct DSIListLink **tail);
+
+static struct DSIListLink *
+ds_ilist_merge(struct DSIListOrder *order,
+               struct DSIListLink *head1, struct DSIListLink *tail1,
+               struct DSIListLink *head2, struct DSIListLink *tail2,
+               struct DSIListLink **tail, bool link_prev);
+
+void
+ds_ilist_init(struct DSIList *lst, size_t offset)
+{
+    lst->length = 0;
+    lst->first = NULL;
+    lst->last = NULL;
+    lst->offset = offset;
+}
+
+void
+ds_ilist_prepend(struct DSIList *lst, struct DSIListLink *link)
+{
+    ds_ilist_insert(lst, NULL, link);
+}
+
+void
+ds_ilist_append(struct DSIList *lst, struct DSIListLink *link)
+{
+    ds_ilist_insert(lst, lst->last, link);
+}
+
+void
+ds_ilist_insert(struct DSIList *lst, struct DSIListLink *after,
+                struct DSIListLink *link)
+{
+    link->prev = after;
+    link->next = after != NULL ? after->next : lst->first;
+
+    if (link->prev != NULL)
+        link->prev->next = link;
+    else
+        lst->first = link;
+
+    if (link->next != NULL)
+        link->next->prev = link;
+    else
+        lst->last = link;
+
+    ++lst->length;
+}
+
+void
+ds_ilist_remove(struct DSIList *lst, struct DSIListLink *link)
+{
+    if (link->prev != NULL)
+        link->prev->next = link->next;
+    else
+        lst->first = link->next;
+
+    if (link->next != NULL)
+        link->next->prev = link->prev;
+    else
+        lst->last = link->prev;
+
+    link->prev = NULL;
+    link->next = NULL;
+
+    --lst->length;
+}
+
+void
+ds_ilist_splice(struct DSIList *dst, struct DSIListLink *after,
+                struct DSIList *src, struct DSIListLink *first,
+                struct DSIListLink *last)
+{
+    struct DSIListLink *link;
+    size_t count;
+
+    /* moving within one list doesn't change its length */
+    count = 0;
+    if (src != dst) {
+        if (first == src->first && last == src->last) {
+            count = src->length;
+        } else {
+            count = 1;
+            for (link = first; link != last; link = link->next)
+                ++count;
+        }
+    }
+
+    /* cut the range out of 'src' */
+    if (first->prev != NULL)
+        first->prev->next = last->next;
+    else
+        src->first = last->next;
+
+    if (last->next != NULL)
+        last->next->prev = first->prev;
+    else
+        src->last = first->prev;
+
+    src->length -= count;
+
+    /* and link it into 'dst' */
+    first->prev = after;
+    last->next = after != NULL ? after->next : dst->first;
+
+    if (after != NULL)
+        after->next = first;
+    else
+        dst->first = first;
+
+    if (last->next != NULL)
+        last->next->prev = last;
+    else
+        dst->last = last;
+
+    dst->length += count;
+}
+
+void
+ds_ilist_map(struct DSIList *lst, void (func)(void*))
+{
+    struct DSIListLink *link;
+
+    for (link = lst->first; link; link = link->next)
+        func(ds_ilist_entry(lst, link));
+}
+
+void
+ds_ilist_sort(struct DSIList *lst, int32_t (compare)(void*, void*))
+{
+    struct DSIListOrder order;
+
+    order.lst = lst;
+    order.by_member = false;
+    order.member_offset = 0;
+    order.compare = compare;
+    ds_ilist_sort_order(&order);
+}
+
+void
+ds_ilist_sort_member(struct DSIList *lst, size_t member_offset,
+                     int32_t (compare)(void*, void*))
+{
+    struct DSIListOrder order;
+
+    order.lst = lst;
+    order.by_member = true;
+    order.member_offset = member_offset;
+    order.compare = compare;
+    ds_ilist_sort_order(&order);
+}
+
+static void *
+ds_ilist_entry(struct DSIList *lst, struct DSIListLink *link)
+{
+    return (char *) link - lst->offset;
+}
+
+/**
+ * This is a bottom-up natural merge sort. Each pass walks the list once,
+ * cutting it into ascending runs and merging neighbouring pairs of them,
+ * until a pass leaves a single run. There is no recursion and no extra
+ * memory, and since ties are taken from the earlier run, it is stable.
+ *
+ * Only 'next' is maintained while merging. The pass that produces the
+ * whole list sets 'prev' as it links, so there is no separate pass to fix
+ * them.
+ */
+static void
+ds_ilist_sort_order(struct DSIListOrder *order)
+{
+    struct DSIList *lst;
+    struct DSIListLink *head, *rest, *run1, *run2, *tail1, *tail2;
+    struct DSIListLink *merged, *merged_tail, *out_tail;
+    size_t merges;
+    bool final;
+
+    lst = order->lst;
+    head = lst->first;
+    if (head == NULL)
+        return;
+
+    for (;;) {
+        rest = head;
+        head = NULL;
+        out_tail = NULL;
+        merges = 0;
+        final = false;
+
+        while (rest != NULL) {
+            run1 = rest;
+            rest = ds_ilist_cut_run(order, run1, &tail1);
+
+            /* an odd run out is carried over to the next pass as is */
+            if (rest == NULL) {
+                merged = run1;
+                merged_tail = tail1;
+            } else {
+                run2 = rest;
+                rest = ds_ilist_cut_run(order, run2, &tail2);
+
+                final = merges == 0 && rest == NULL;
+                merged = ds_ilist_merge(order, run1, tail1, run2, tail2,
+                                        &merged_tail, final);
+                ++merges;
+            }
+
+            if (out_tail == NULL)
+                head = merged;
+            else
+                out_tail->next = merged;
+            out_tail = merged_tail;
+        }
+
+        /* A list that is a single run is already sorted, and since nothing
+         * was relinked, its 'prev' links are still right. */
+        if (merges == 0 || final)
+            break;
+    }
+
+    lst->first = head;
+    lst->last = out_tail;
+}
+
+static void *
+ds_ilist_sort_value(struct DSIListOrder *order, struct DSIListLink *link)
+{
+    void *entry;
+
+    entry = ds_ilist_entry(order->lst, link);
+    if (order->by_member)
+        return *(void **) ((char *) entry + order->member_offset);
+    return entry;
+}
+
+/* Cuts the ascending run starting at 'head' off from the rest of the list.
+ * Its last link is stored in 'tail', and the start of the rest of the list
+ * (or NULL) is returned. */
+static struct DSIListLink *
+ds_ilist_cut_run(struct DSIListOrder *order, struct DSIListLink *head,
+                 struct DSIListLink **tail)
+{
+    struct DSIListLink *rest;
+
+    while (head->next != NULL
+           && order->compare(ds_ilist_sort_value(order, head),
+                             ds_ilist_sort_value(order, head->next)) <= 0)
+        head = head->next;
+
+    rest = head->next;
+    head->next = NULL;
+    *tail = head;
+
+    return rest;
+}
+
+/* Merges two runs and returns the first link of the result. Its last link
+ * is stored in 'tail'. If 'link_prev' is true, 'prev' is fixed in every
+ * link of the result, which then becomes a proper doubly linked list. */
+static struct DSIListLink *
+ds_ilist_merge(struct DSIListOrder *order,
+               struct DSIListLink *head1, struct DSIListLink *tail1,
+               struct DSIListLink *head2, struct DSIListLink *tail2,
+               struct DSIListLink **tail, bool link_prev)
+{
+    struct DSIListLink start, *last, *next;
+
+    last = &start;
+    while (head1 != NULL && head2 != NULL) {
+        if (order->compare(ds_ilist_sort_value(order, head1),
+                           ds_ilist_sort_value(order, head2)) <= 0) {
+            next = head1;
+            head1 = head1->next;
+        } else {
+            next = head2;
+            head2 = head2->next;
+        }
+
+        last->next = next;
+        if (link_prev)
+            next->prev = last;
+        last = next;
+    }
+
+    /* the rest of whichever run is left over is already in order */
+    if (head1 != NULL) {
+        last->next = head1;
+        *tail = tail1;
+    } else {
+        last->next = head2;
+        *tail = tail2;
+    }
+
+    if (link_prev) {
+        for (; last->next != NULL; last = last->next)
+            last->next->prev = last;
+        start.next->prev = NULL;
+    }
+
+    return start.next;
+}
@@ -0,0 +1,130 @@
+#ifndef __LIBDS_ILIST_H__
+#define __LIBDS_ILIST_H__
+
+/* #define NDEBUG */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A DSIList is an intrusive doubly linked list: instead of allocating a
+ * node that points at the data, the links live inside the data itself.
+ * Any struct can be put in a list by giving it a DSIListLink member:
+ *
+ *  struct job {
+ *      int priority;
+ *      struct DSIListLink link;
+ *  };
+ *
+ *  struct DSIList jobs;
+ *  struct DSIListLink *link;
+ *
+ *  ds_ilist_init(&jobs, offsetof(struct job, link));
+ *  ds_ilist_append(&jobs, &some_job->link);
+ *
+ *  for (link = jobs.first; link != NULL; link = link->next)
+ *      run(DS_ILIST_ENTRY(link, struct job, link));
+ *
+ * Linking and unlinking never allocate, and the list never frees anything.
+ * An element can be in as many lists at once as it has links, but each
+ * link can be in only one list at a time.
+ */
+struct DSIListLink {
+    struct DSIListLink *prev;
+    struct DSIListLink *next;
+};
+
+struct DSIList {
+    size_t length;
+    struct DSIListLink *first;
+    struct DSIListLink *last;
+
+    /* Where the link is in the elements of this list, as given by
+     * offsetof. Used to hand whole elements to 'compare' and 'func'. */
+    size_t offset;
+};
+
+/**
+ * Gets a pointer to the element of type 'type' that contains 'link' as its
+ * member 'member'.
+ */
+#define DS_ILIST_ENTRY(link, type, member) \
+    ((type *) ((char *) (link) - offsetof(type, member)))
+
+/**
+ * Initializes an empty list of elements whose link is at 'offset'.
+ * There is nothing to free when done with the list.
+ */
+void
+ds_ilist_init(struct DSIList *lst, size_t offset);
+
+/**
+ * Links 'link' in at the beginning of the list.
+ * Runs in constant time.
+ */
+void
+ds_ilist_prepend(struct DSIList *lst, struct DSIListLink *link);
+
+/**
+ * Links 'link' in at the end of the list.
+ * Runs in constant time.
+ */
+void
+ds_ilist_append(struct DSIList *lst, struct DSIListLink *link);
+
+/**
+ * Links 'link' in after 'after'. If 'after' is NULL, then 'link' will be
+ * put at the beginning of the list.
+ * Runs in constant time.
+ */
+void
+ds_ilist_insert(struct DSIList *lst, struct DSIListLink *after,
+                struct DSIListLink *link);
+
+/**
+ * Unlinks 'link' from the list. The element itself is left alone.
+ * Runs in constant time.
+ */
+void
+ds_ilist_remove(struct DSIList *lst, struct DSIListLink *link);
+
+/**
+ * Moves the links from 'first' to 'last' (inclusive) out of 'src' and into
+ * 'dst' after 'after' (or at the beginning of 'dst' if 'after' is NULL).
+ * 'src' and 'dst' may be the same list, as long as 'after' is not in the
+ * range being moved.
+ * Relinking takes constant time; the links in the range are counted to
+ * keep the lengths right, unless the whole of 'src' is moved.
+ */
+void
+ds_ilist_splice(struct DSIList *dst, struct DSIListLink *after,
+                struct DSIList *src, struct DSIListLink *first,
+                struct DSIListLink *last);
+
+/**
+ * Convenience function to map a funcion across all elements in the list.
+ * 'func' is given the elements, not their links.
+ */
+void
+ds_ilist_map(struct DSIList *lst, void (func)(void*));
+
+/**
+ * Sorts the list in place, comparing elements (not their links) with
+ * 'compare' as in ds_list_sort. The sort is a stable, iterative natural
+ * merge sort, and relinks the elements without moving them.
+ */
+void
+ds_ilist_sort(struct DSIList *lst, int32_t (compare)(void*, void*));
+
+/**
+ * Sorts the list like ds_ilist_sort, but hands 'compare' the 'void *'
+ * member found 'member_offset' bytes (as given by offsetof) into each
+ * element, rather than the element itself.
+ */
+void
+ds_ilist_sort_member(struct DSIList *lst, size_t member_offset,
+                     int32_t (compare)(void*, void*));
+
+#endif
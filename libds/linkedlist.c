@@ -3,18 +3,34 @@
 
 #include <stdio.h>
 
+#include "ilist.h"
 #include "linkedlist.h"
 
 /* private helper functions */
+static void
+ds_list_to_ilist(struct DSLinkedList *lst, struct DSIList *ilst);
+
+static void
+ds_list_from_ilist(struct DSLinkedList *lst, struct DSIList *ilst);
+
 static void
 ds_list_unlink(struct DSLinkedList *lst, struct DSListNode *remove);
 
-static struct DSListNode * 
-ds_list_mergesort(struct DSListNode *head, int32_t (compare)(void*, void*));
+static void
+ds_list_free_nodes(struct DSLinkedList *lst, bool free_data);
 
 static struct DSListNode *
-ds_list_merge(struct DSListNode *head1, struct DSListNode *head2,
-              int32_t (compare)(void*, void*));
+ds_list_node_alloc(struct DSLinkedList *lst);
+
+static void
+ds_list_node_free(struct DSLinkedList *lst, struct DSListNode *node);
+
+static void
+ds_list_pool_release(struct DSListPool *pool);
+
+static struct DSIListLink *
+ds_list_link(struct DSListNode *node);
+
 
 struct DSLinkedList *
 ds_list_create()
@@ -27,38 +43,89 @@ ds_list_create()
     lst->length = 0;
     lst->first = NULL;
     lst->last = NULL;
+    lst->pool = NULL;
 
     return lst;
 }
 
-void
-ds_list_free(struct DSLinkedList *lst)
+struct DSLinkedList *
+ds_list_create_pool(struct DSListPool *pool)
 {
-    struct DSListNode *node, *temp;
+    struct DSLinkedList *lst;
 
-    node = lst->first;
-    while (node != NULL) {
-        temp = node->next;
-        free(node->data);
-        free(node);
-        node = temp;
-    }
+    lst = ds_list_create();
 
-    free(lst);
+    if (pool == NULL)
+        pool = ds_list_pool_create();
+    else
+        ++pool->refs;
+
+    lst->pool = pool;
+
+    return lst;
+}
+
+struct DSListPool *
+ds_list_pool_create()
+{
+    struct DSListPool *pool;
+
+    pool = malloc(sizeof(*pool));
+    assert(pool);
+
+    pool->slabs = NULL;
+    pool->free = NULL;
+    pool->fresh = NULL;
+    pool->fresh_left = 0;
+    pool->slab_size = DS_LIST_POOL_BASE_SLAB;
+    pool->refs = 1;
+
+    return pool;
+}
+
+void
+ds_list_pool_free(struct DSListPool *pool)
+{
+    ds_list_pool_release(pool);
+}
+
+void
+ds_list_free(struct DSLinkedList *lst)
+{
+    ds_list_free_nodes(lst, true);
 }
 
 void
 ds_list_free_no_data(struct DSLinkedList *lst)
 {
-    struct DSListNode *node, *temp;
+    ds_list_free_nodes(lst, false);
+}
 
-    node = lst->first;
-    while (node != NULL) {
-        temp = node->next;
-        free(node);
-        node = temp;
+static void
+ds_list_free_nodes(struct DSLinkedList *lst, bool free_data)
+{
+    struct DSListNode *node, *temp;
+    bool bulk;
+
+    /* When nothing else uses the pool, its slabs are all released below,
+     * so the nodes don't need to be visited one by one. */
+    bulk = lst->pool != NULL && lst->pool->refs == 1;
+
+    if (free_data || !bulk) {
+        node = lst->first;
+        while (node != NULL) {
+            temp = ds_list_next(node);
+            if (free_data)
+                free(node->data);
+            if (!bulk)
+                ds_list_node_free(lst, node);
+            node = temp;
+        }
     }
 
+    if (lst->pool != NULL)
+        ds_list_pool_release(lst->pool);
+
     free(lst);
 }
 
@@ -78,125 +145,94 @@ void
 ds_list_insert(struct DSLinkedList *lst, struct DSListNode *after, void *data)
 {
     struct DSListNode *newnode;
+    struct DSIList ilst;
 
-    newnode = malloc(sizeof(*newnode));
-    assert(newnode);
+    newnode = ds_list_node_alloc(lst);
 
     newnode->data = data;
-    newnode->next = NULL;
-    newnode->prev = NULL;
-
-    /* make sure the list obeys invariants */
-    assert((lst->first == NULL && lst->last == NULL) ||
-           (lst->first != NULL && lst->last != NULL));
 
-    /* If the list is empty, make this node the first and last always */
-    if (lst->first == NULL && lst->last == NULL) {
-        lst->first = newnode;
-        lst->last = newnode;
-    }
-
-    /* if after is NULL, make it the first node */
-    else if (after == NULL) {
-        lst->first->prev = newnode;
-        newnode->next = lst->first;
-        lst->first = newnode;
-
-        /* if last was also the first, last is still the same */
-    }
-
-    /* shortcut: check to see if 'after' is the last node */
-    else if (after == lst->last) {
-        lst->last->next = newnode;
-        newnode->prev = lst->last;
-        lst->last = newnode;
-
-        /* if first was also the last, first is still the same */
-    }
-
-    /* Find the 'after' node and insert 'newnode' after it in the list. */
-    else {
-        newnode->next = after->next;
-        newnode->prev = after;
-        after->next = newnode;
-
-        /* we know after cannot be NULL and cannot be the last node */
-        /* if it was first, then this works fine */
-    }
-
-    ++lst->length;
+    ds_list_to_ilist(lst, &ilst);
+    ds_ilist_insert(&ilst, ds_list_link(after), &newnode->link);
+    ds_list_from_ilist(lst, &ilst);
 }
 
 struct DSLinkedList *
 ds_list_copy(struct DSLinkedList *lst)
 {
     struct DSLinkedList *copy;
-    struct DSListNode *node, *lastnode;
-
-    copy = ds_list_create();
+    struct DSListNode *node;
 
-    lastnode = NULL;
-    for (node = lst->last; node; node = node->prev) {
-        struct DSListNode *newnode;
+    if (lst->pool != NULL)
+        copy = ds_list_create_pool(lst->pool);
+    else
+        copy = ds_list_create();
 
-        newnode = malloc(sizeof(*newnode));
-        assert(newnode);
+    for (node = lst->first; node; node = ds_list_next(node))
+        ds_list_append(copy, node->data);
 
-        newnode->data = node->data;
-        newnode->next = lastnode;
-        newnode->prev = NULL;
+    return copy;
+}
 
-        if (node == lst->first)
-            copy->first = newnode;
-        else if (node == lst->last)
-            copy->last = newnode;
+void
+ds_list_concat(struct DSLinkedList *dst, struct DSLinkedList *src)
+{
+    if (src->first != NULL)
+        ds_list_splice(dst, dst->last, src, src->first, src->last);
+}
 
-        lastnode = newnode;
+void
+ds_list_splice(struct DSLinkedList *dst, struct DSListNode *after,
+               struct DSLinkedList *src, struct DSListNode *first,
+               struct DSListNode *last)
+{
+    struct DSIList idst, isrc;
+
+    /* a node must go back to the pool it came from */
+    assert(dst->pool == src->pool);
+
+    ds_list_to_ilist(dst, &idst);
+    if (src == dst) {
+        ds_ilist_splice(&idst, ds_list_link(after), &idst,
+                        &first->link, &last->link);
+    } else {
+        ds_list_to_ilist(src, &isrc);
+        ds_ilist_splice(&idst, ds_list_link(after), &isrc,
+                        &first->link, &last->link);
+        ds_list_from_ilist(src, &isrc);
     }
+    ds_list_from_ilist(dst, &idst);
+}
 
-    /* now fix 'prev' in each of our new nodes */
-    lastnode = NULL;
-    for (node = copy->first; node; node = node->next) {
-        node->prev = lastnode;
-        lastnode = node;
-    }
+struct DSLinkedList *
+ds_list_split_at(struct DSLinkedList *lst, struct DSListNode *node)
+{
+    struct DSLinkedList *rest;
 
-    copy->length = lst->length;
+    if (lst->pool != NULL)
+        rest = ds_list_create_pool(lst->pool);
+    else
+        rest = ds_list_create();
 
-    return copy;
+    ds_list_splice(rest, NULL, lst, node, lst->last);
+
+    return rest;
 }
 
 static void
 ds_list_unlink(struct DSLinkedList *lst, struct DSListNode *remove)
 {
-    if (remove == lst->first && remove == lst->last) {
-        lst->first = NULL;
-        lst->last = NULL;
-    }
-
-    else if (remove == lst->first) {
-        lst->first = lst->first->next;
-        lst->first->prev = NULL;
-    }
-
-    else if (remove == lst->last) {
-        lst->last = lst->last->prev;
-        lst->last->next = NULL;
-    }
-
-    else {
-        remove->prev->next = remove->next;
-        remove->next->prev = remove->prev;
-    }
+    struct DSIList ilst;
 
-    --lst->length;
+    ds_list_to_ilist(lst, &ilst);
+    ds_ilist_remove(&ilst, &remove->link);
+    ds_list_from_ilist(lst, &ilst);
 }
 
 void
 ds_list_remove(struct DSLinkedList *lst, struct DSListNode *remove)
 {
     ds_list_unlink(lst, remove);
-    free(remove);
+    ds_list_node_free(lst, remove);
 }
 
 void
@@ -205,93 +241,140 @@ ds_list_destroy(struct DSLinkedList *lst, struct DSListNode *remove)
     ds_list_unlink(lst, remove);
 
     free(remove->data);
-    free(remove);
+    ds_list_node_free(lst, remove);
 }
 
 void
-ds_list_map(struct DSLinkedList *lst, void (func)(void*))
+ds_list_iter_remove(struct DSLinkedList *lst, struct DSListIter *iter)
 {
-    struct DSListNode *node;
+    assert(iter->current != NULL);
 
-    for (node = lst->first; node; node = node->next)
-        func(node->data);
+    ds_list_remove(lst, iter->current);
+    iter->current = NULL;
 }
 
-/**
- * This implementation of mergesort in place on a linked list is based on
- * http://www.c.happycodings.com/Sorting_Searching/code10.html
- *
- * It is not efficient as possible, namely because I fix the doubly linked
- * attributes (the tail and prev attributes) after the list is sorted.
- */
 void
-ds_list_sort(struct DSLinkedList *lst, int32_t (compare)(void*, void*))
+ds_list_iter_destroy(struct DSLinkedList *lst, struct DSListIter *iter)
 {
-    struct DSListNode *head;
-
-    head = ds_list_mergesort(lst->first, compare);
+    assert(iter->current != NULL);
 
-    /* set the first node of the list */
-    lst->first = head;
-    lst->first->prev = NULL;
+    ds_list_destroy(lst, iter->current);
+    iter->current = NULL;
+}
 
-    /* now find the last node and set that */
-    /* while we're at it, fix 'prev' in each node */
-    while (head->next) {
-        head->next->prev = head;
-        head = head->next;
-    }
+void
+ds_list_map(struct DSLinkedList *lst, void (func)(void*))
+{
+    struct DSListNode *node;
 
-    lst->last = head;
-    lst->last->next = NULL;
+    for (node = lst->first; node; node = ds_list_next(node))
+        func(node->data);
 }
 
-struct DSListNode * 
-ds_list_mergesort(struct DSListNode *head, int32_t (compare)(void*, void*)) 
+/* Gets memory for a new node, either from malloc or the list's pool.
+ * Pools reuse removed nodes first, and otherwise hand out the nodes of
+ * their newest slab in order. Slabs double in size up to a limit. */
+static struct DSListNode *
+ds_list_node_alloc(struct DSLinkedList *lst)
 {
-    struct DSListNode *head1, *head2;
+    struct DSListPool *pool;
+    struct DSListNode *node, *slab;
+
+    if (lst->pool == NULL) {
+        node = malloc(sizeof(*node));
+        assert(node);
+        return node;
+    }
 
-    if (head == NULL || head->next == NULL)
-        return head;
+    pool = lst->pool;
 
-    /* cut the list in half */
-    head1 = head;
-    head2 = head->next;
-    while(head2 != NULL && head2->next != NULL) {
-        head = head->next;
-        head2 = head->next->next;
+    if (pool->free != NULL) {
+        node = pool->free;
+        pool->free = node->data;
+        return node;
     }
 
-    head2 = head->next;
-    head->next = NULL;
+    if (pool->fresh_left == 0) {
+        slab = malloc((pool->slab_size + 1) * sizeof(*slab));
+        assert(slab);
+
+        slab->data = pool->slabs;
+        pool->slabs = slab;
+        pool->fresh = slab + 1;
+        pool->fresh_left = pool->slab_size;
 
-    return ds_list_merge(ds_list_mergesort(head1, compare),
-                         ds_list_mergesort(head2, compare),
-                         compare);
+        if (pool->slab_size < DS_LIST_POOL_MAX_SLAB)
+            pool->slab_size *= 2;
+    }
+
+    --pool->fresh_left;
+    return pool->fresh++;
 }
 
-struct DSListNode *
-ds_list_merge(struct DSListNode *head1, struct DSListNode *head2,
-              int32_t (compare)(void*, void*))
+static void
+ds_list_node_free(struct DSLinkedList *lst, struct DSListNode *node)
 {
-    struct DSListNode *head3;
+    if (lst->pool == NULL) {
+        free(node);
+        return;
+    }
 
-    if (head1 == NULL)
-        return head2;
+    node->data = lst->pool->free;
+    lst->pool->free = node;
+}
 
-    if (head2 == NULL)
-        return head1;
+static void
+ds_list_pool_release(struct DSListPool *pool)
+{
+    struct DSListNode *slab, *temp;
 
-    if (compare(head1->data, head2->data) < 0) {
-        head3 = head1;
-        head3->next = ds_list_merge(head1->next, head2, compare);
-    }
+    if (--pool->refs > 0)
+        return;
 
-    else {
-        head3 = head2;
-        head3->next = ds_list_merge(head1, head2->next, compare);
+    slab = pool->slabs;
+    while (slab != NULL) {
+        temp = slab->data;
+        free(slab);
+        slab = temp;
     }
 
-    return head3;
+    free(pool);
 }
 
+/* The sort is DSIList's, comparing the 'data' of each node. */
+void
+ds_list_sort(struct DSLinkedList *lst, int32_t (compare)(void*, void*))
+{
+    struct DSIList ilst;
+
+    ds_list_to_ilist(lst, &ilst);
+    ds_ilist_sort_member(&ilst, offsetof(struct DSListNode, data), compare);
+    ds_list_from_ilist(lst, &ilst);
+}
+
+/* Views the list as an intrusive list of its nodes, for the time of a call
+ * to a DSIList function, after which ds_list_from_ilist copies the
+ * changes back. */
+static void
+ds_list_to_ilist(struct DSLinkedList *lst, struct DSIList *ilst)
+{
+    ds_ilist_init(ilst, offsetof(struct DSListNode, link));
+    ilst->length = lst->length;
+    ilst->first = ds_list_link(lst->first);
+    ilst->last = ds_list_link(lst->last);
+}
+
+static void
+ds_list_from_ilist(struct DSLinkedList *lst, struct DSIList *ilst)
+{
+    lst->length = ilst->length;
+    lst->first = ds_list_node(ilst->first);
+    lst->last = ds_list_node(ilst->last);
+}
+
+/* The inverse of ds_list_node: the link of 'node', or NULL for no node. */
+static struct DSIListLink *
+ds_list_link(struct DSListNode *node)
+{
+    return node == NULL ? NULL : &node->link;
+}
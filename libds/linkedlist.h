@@ -5,22 +5,82 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "ilist.h"
+
+/* some private constants for node pool tuning */
+static const size_t DS_LIST_POOL_BASE_SLAB = 16;
+static const size_t DS_LIST_POOL_MAX_SLAB = 4096;
+
 struct DSLinkedList {
-    uint32_t length;
+    size_t length;
     struct DSListNode *first;
     struct DSListNode *last;
+
+    /* Where nodes come from. NULL means every node is malloc'd. */
+    struct DSListPool *pool;
 };
 
+/* A node is linked through a DSIListLink, so that the list shares its
+ * linking and sorting code with DSIList. Use 'ds_list_next' and
+ * 'ds_list_prev' to get from one node to the next. */
 struct DSListNode {
+    struct DSIListLink link;
     void* data;
-    struct DSListNode *prev;
-    struct DSListNode *next;
 };
 
+/**
+ * A DSListPool hands out list nodes from slabs of many nodes at a time,
+ * and keeps removed nodes on a free list for reuse. Nodes appended one
+ * after another end up next to each other in memory, and all of a pool's
+ * memory is released at once when it is freed.
+ *
+ * A pool may be shared by several lists (it is reference counted and
+ * freed along with the last list using it), but like the lists
+ * themselves, it is not thread safe.
+ */
+struct DSListPool {
+    /* Slabs are arrays of nodes. The first node of each slab only points
+     * to the next slab with 'data'. */
+    struct DSListNode *slabs;
+
+    /* Removed nodes, each pointing to the next with 'data'. */
+    struct DSListNode *free;
+
+    /* Nodes in the newest slab that have never been handed out. */
+    struct DSListNode *fresh;
+    size_t fresh_left;
+
+    /* The number of nodes in the next slab. */
+    size_t slab_size;
+
+    /* The number of lists using the pool, plus one for its creator until
+     * ds_list_pool_free is called. */
+    size_t refs;
+};
+
+/**
+ * A DSListIter walks a list forward or backward. The node most recently
+ * returned by 'ds_list_iter_next' can be removed from the list while
+ * iterating, since the iterator already knows which node comes after it.
+ *
+ *  struct DSListIter iter;
+ *  struct DSListNode *node;
+ *
+ *  ds_list_iter_begin(lst, &iter, false);
+ *  while (NULL != (node = ds_list_iter_next(&iter)))
+ *      if (should_drop(node->data))
+ *          ds_list_iter_remove(lst, &iter);
+ */
 struct DSListIter {
+    /* The node most recently returned by ds_list_iter_next (or NULL). */
     struct DSListNode *current;
+
+    /* The node that ds_list_iter_next will return. */
+    struct DSListNode *next;
+
     bool reverse;
 };
 
@@ -31,6 +91,30 @@ struct DSListIter {
 struct DSLinkedList * 
 ds_list_create();
 
+/**
+ * Initializes memory for a DSLinkedList whose nodes come from 'pool'.
+ * If 'pool' is NULL, the list gets a pool of its own, which is released
+ * in one go by 'ds_list_free'.
+ * 'ds_list_free' should be called when done with the list.
+ */
+struct DSLinkedList *
+ds_list_create_pool(struct DSListPool *pool);
+
+/**
+ * Creates a node pool that can be shared by lists created with
+ * 'ds_list_create_pool'.
+ * 'ds_list_pool_free' should be called when done creating lists with it.
+ */
+struct DSListPool *
+ds_list_pool_create();
+
+/**
+ * Gives up the creator's hold on a pool. Its memory is released once
+ * every list using it has been freed too.
+ */
+void
+ds_list_pool_free(struct DSListPool *pool);
+
 /**
  * Frees all memory associated with the list and its nodes.
  */
@@ -68,10 +152,44 @@ ds_list_insert(struct DSLinkedList *lst, struct DSListNode *after, void *data);
 
 /**
  * Copies a list's structure. Data is not copied.
+ * The copy takes its nodes from the same pool as 'lst'.
  */
 struct DSLinkedList *
 ds_list_copy(struct DSLinkedList *lst);
 
+/**
+ * Moves all of the nodes of 'src' to the end of 'dst', leaving 'src'
+ * empty. Both lists must take their nodes from the same pool (or both
+ * from none). 'src' still needs to be freed.
+ * Runs in constant time.
+ */
+void
+ds_list_concat(struct DSLinkedList *dst, struct DSLinkedList *src);
+
+/**
+ * Moves the nodes from 'first' to 'last' (inclusive) out of 'src' and
+ * into 'dst' after 'after' (or at the beginning of 'dst' if 'after' is
+ * NULL). No nodes are allocated or freed, so both lists must take their
+ * nodes from the same pool (or both from none). 'src' and 'dst' may be the
+ * same list, as long as 'after' is not in the range being moved.
+ * Relinking takes constant time; the nodes in the range are counted to
+ * keep the lengths right, unless the whole of 'src' is moved.
+ */
+void
+ds_list_splice(struct DSLinkedList *dst, struct DSListNode *after,
+               struct DSLinkedList *src, struct DSListNode *first,
+               struct DSListNode *last);
+
+/**
+ * Splits a list in two. 'node' and every node after it are moved to a new
+ * list, which is returned, and which takes its nodes from the same pool.
+ * The nodes moved are counted, so this runs in time proportional to their
+ * number; the links are changed in constant time.
+ * 'ds_list_free' should be called when done with the new list.
+ */
+struct DSLinkedList *
+ds_list_split_at(struct DSLinkedList *lst, struct DSListNode *node);
+
 /**
  * Removes an element from a list but does NOT free the data's memory.
  * Runs in constant time.
@@ -86,6 +204,77 @@ ds_list_remove(struct DSLinkedList *lst, struct DSListNode *remove);
 void
 ds_list_destroy(struct DSLinkedList *lst, struct DSListNode *remove);
 
+/**
+ * Returns the node that 'link' is the link of, or NULL if 'link' is NULL.
+ */
+static __inline__ struct DSListNode *
+ds_list_node(struct DSIListLink *link)
+{
+    return link == NULL ? NULL : DS_ILIST_ENTRY(link, struct DSListNode, link);
+}
+
+/**
+ * Returns the node after 'node', or NULL if it is the last one.
+ */
+static __inline__ struct DSListNode *
+ds_list_next(struct DSListNode *node)
+{
+    return ds_list_node(node->link.next);
+}
+
+/**
+ * Returns the node before 'node', or NULL if it is the first one.
+ */
+static __inline__ struct DSListNode *
+ds_list_prev(struct DSListNode *node)
+{
+    return ds_list_node(node->link.prev);
+}
+
+/**
+ * Starts iterating over a list, from the first node, or from the last node
+ * when 'reverse' is true.
+ * (Defined here so that iterating compiles down to a plain loop.)
+ */
+static __inline__ void
+ds_list_iter_begin(struct DSLinkedList *lst, struct DSListIter *iter,
+                   bool reverse)
+{
+    iter->current = NULL;
+    iter->next = reverse ? lst->last : lst->first;
+    iter->reverse = reverse;
+}
+
+/**
+ * Returns the next node of the iteration, or NULL when there is none.
+ */
+static __inline__ struct DSListNode *
+ds_list_iter_next(struct DSListIter *iter)
+{
+    iter->current = iter->next;
+    if (iter->current != NULL)
+        iter->next = iter->reverse ? ds_list_prev(iter->current)
+                                   : ds_list_next(iter->current);
+
+    return iter->current;
+}
+
+/**
+ * Removes the node most recently returned by 'ds_list_iter_next' from the
+ * list, but does NOT free the data's memory. Iteration continues with the
+ * node that followed it. Removing any other node while iterating is not
+ * safe if it happens to be the next one.
+ * Runs in constant time.
+ */
+void
+ds_list_iter_remove(struct DSLinkedList *lst, struct DSListIter *iter);
+
+/**
+ * Like 'ds_list_iter_remove', but DOES free the data's memory.
+ */
+void
+ds_list_iter_destroy(struct DSLinkedList *lst, struct DSListIter *iter);
+
 /**
  * Convenience function to map a funcion across all elements in the list.
  */
@@ -94,6 +283,9 @@ ds_list_map(struct DSLinkedList *lst, void (func)(void*));
 
 /**
  * A function that sort the given list in place.
+ * The sort is stable, iterative and uses no extra memory. It runs in
+ * O(n log r) time for a list made of r ascending runs, so a sorted list
+ * takes a single pass.
  */
 void
 ds_list_sort(struct DSLinkedList *lst, int32_t (compare)(void*, void*));
@@ -1,163 +1,1442 @@
+/* for pthread_condattr_setclock, clock_gettime and sysconf */
+#define _POSIX_C_SOURCE 200112L
+
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "queue.h"
 
+/* The size of a cache line. The positions that producers and consumers
+ * race on are kept this far apart so that they don't share a line. */
+#define DS_QUEUE_CACHE_LINE 64
+
+/* A slot of the circular buffer. */
+struct DSQueueCell {
+    /* Says which position (see below) may use the cell next, and how.
+     * When seq = 2p, the cell is free for the put of position p; when
+     * seq = 2p + 1, it holds the item of position p, ready to be gotten.
+     * So a cell at index i starts with seq = 2i, and getting the item of
+     * position p frees the cell for position p + capacity.
+     * (Vyukov uses p and p + 1 instead, which can't tell a full cell from
+     * an empty one when the capacity is 1.) */
+    size_t seq;
+    void *item;
+};
+
+/* The state bits of a slot of an unbounded queue. */
+#define DS_QUEUE_SLOT_WRITTEN 1  /* the item has been stored */
+#define DS_QUEUE_SLOT_READ 2     /* the item has been taken */
+#define DS_QUEUE_SLOT_DESTROY 4  /* the segment waits on this slot's reader
+                                  * to free it */
+
+/* In the get position of an unbounded queue, the low bit is set when the
+ * segment it is in is known not to be the last. The positions themselves
+ * are shifted past it. */
+#define DS_QUEUE_HAS_NEXT 1
+#define DS_QUEUE_SHIFT 1
+
+/* A slot of a segment of an unbounded queue. */
+struct DSQueueSlot {
+    void *item;
+    unsigned int state;
+};
+
+/* A segment of an unbounded queue: a fixed run of slots, each used only
+ * once, and linked to the next segment when the producers reach its
+ * end. */
+struct DSQueueSegment {
+    struct DSQueueSegment *next;
+
+    /* (This is allocated to `seg_capacity` entries.) */
+    struct DSQueueSlot slots[1];
+};
+
+/* The threads blocked on one side of a queue: producers on a full queue,
+ * or consumers on an empty one. */
+struct DSQueueWaiters {
+    /* The number of threads about to block that haven't been picked to be
+     * woken yet. While it is 0, the other side never touches the mutex. */
+    size_t waiting;
+
+    /* Wakeups handed out but not yet taken by a woken thread. A thread
+     * only returns from waiting by taking one, so spurious wakeups are
+     * ignored, and each wakeup is taken by a single thread. */
+    size_t wakeups;
+
+    pthread_cond_t cond;
+
+    /* The threads in a select on this queue (among others), and how many.
+     * Every wake notifies all of them. */
+    struct DSQueueSelectNode *selects;
+    size_t selecting;
+};
+
+/* A thread blocked in ds_queue_select_get or ds_queue_select_put. It
+ * sleeps on its own condition variable, which any of its queues can
+ * notify. */
+struct DSQueueSelector {
+    pthread_mutex_t mutate;
+    pthread_cond_t cond;
+
+    /* Set when one of the queues may have become ready. */
+    bool ready;
+};
+
+/* Links a selector into the waiters of one of its queues. */
+struct DSQueueSelectNode {
+    struct DSQueueSelector *selector;
+    struct DSQueueSelectNode *prev;
+    struct DSQueueSelectNode *next;
+};
+
+/* Where the next select starts scanning its queues, so that no queue is
+ * always checked first and starves the others. */
+static size_t ds_queue_select_start = 0;
 
 struct DSQueue {
     /* An array of elements in the queue. */
-    void **buf;
+    struct DSQueueCell *buf;
+
+    /* The total number of allowable items in the queue */
+    size_t capacity;
 
-    /* The position of the first element in the queue. */
-    uint32_t pos;
+    /* The number of slots in each segment of an unbounded queue, which
+     * has no `buf`. 0 for a bounded queue. */
+    size_t seg_capacity;
 
-    /* The number of items currently in the queue.
-     * When `length` = 0, ds_queue_get will block.
-     * When `length` = `capacity`, ds_queue_put will block. */
-    uint32_t length;
+    /* Called, with `high_water_data`, when an unbounded queue grows to
+     * `high_water` items, if that isn't 0. `above_high_water` is set from
+     * then until it drains below the mark again. Set before the queue is
+     * shared, and only read after. */
+    size_t high_water;
+    void (*high_water_func)(struct DSQueue *, size_t, void *);
+    void *high_water_data;
+    bool above_high_water;
 
-    /* The total number of allowable items in the queue */
-    uint32_t capacity;
+    /* How many rounds a thread spins, then yields, on a full (or empty)
+     * queue before it blocks. See ds_queue_backoff. */
+    size_t spins;
+    size_t yields;
+
+    char pad0[DS_QUEUE_CACHE_LINE];
+
+    /* The position of the next item to put. Positions only ever increase;
+     * position p is stored in buf[p % capacity].
+     * In an unbounded queue, the segment position p is in, at slot
+     * p % (seg_capacity + 1). See ds_queue_seg_push. */
+    size_t enqueue_pos;
+    struct DSQueueSegment *tail_seg;
 
-    /* When true, the queue has been closed. A run-time error will occur
-     * if a value is sent to a closed queue. */
+    /* The number of puts that have seen the queue open, and haven't yet
+     * published what they put. See ds_queue_try_push_open. */
+    size_t producers;
+    char pad1[DS_QUEUE_CACHE_LINE - 2 * sizeof(size_t) - sizeof(void*)];
+
+    /* The position of the next item to get. */
+    size_t dequeue_pos;
+    struct DSQueueSegment *head_seg;
+    char pad2[DS_QUEUE_CACHE_LINE - sizeof(size_t) - sizeof(void*)];
+
+    /* When true, the queue has been closed, and puts fail with
+     * DS_QUEUE_CLOSED. */
     bool closed;
 
-    /* Guards the modification of `length` (a condition variable) and `pos`. */
-    pthread_mutex_t mutate;
+    /* Set once the queue is closed and every put that got in before the
+     * close has published its items, so that a get which finds the queue
+     * empty after seeing it set can stop. */
+    bool sealed;
 
-    /* A condition variable that is pinged whenever `length` has changed or
-     * when the queue has been closed. */
-    pthread_cond_t cond_length;
+    /* Producers waiting for room, and consumers waiting for items. */
+    struct DSQueueWaiters not_full;
+    struct DSQueueWaiters not_empty;
+
+    /* Guards blocking on the condition variables of both. */
+    pthread_mutex_t mutate;
 };
 
+/* private helper functions */
+static struct DSQueue *
+ds_queue_alloc(void);
+
+static struct DSQueueSegment *
+ds_queue_segment_create(size_t capacity);
+
+static void
+ds_queue_segment_release(struct DSQueueSegment *seg, size_t start,
+                         size_t capacity);
+
+static void
+ds_queue_seg_push(struct DSQueue *queue, void *item);
+
+static bool
+ds_queue_seg_pop(struct DSQueue *queue, void **item);
+
+static size_t
+ds_queue_seg_length(struct DSQueue *queue);
+
+static void
+ds_queue_high_water_check(struct DSQueue *queue, bool filled);
+
+static void
+ds_queue_snooze(size_t *round);
+
+static size_t
+ds_queue_try_push_many(struct DSQueue *queue, void **items, size_t n);
+
+static bool
+ds_queue_try_push_open(struct DSQueue *queue, void **items, size_t n,
+                       size_t *count);
+
+static size_t
+ds_queue_try_pop_many(struct DSQueue *queue, void **items, size_t max);
+
+static int
+ds_queue_put_until(struct DSQueue *queue, void **items, size_t n,
+                   size_t *done, const struct timespec *deadline);
+
+static int
+ds_queue_get_until(struct DSQueue *queue, void **items, size_t max,
+                   size_t *count, const struct timespec *deadline);
+
+static int
+ds_queue_select(struct DSQueue **queues, size_t n, size_t *index,
+                void **item, uint64_t timeout_ns, bool put);
+
+static int
+ds_queue_select_try(struct DSQueue **queues, size_t n, size_t start,
+                    size_t *index, void **item, bool put);
+
+static void
+ds_queue_select_add(struct DSQueue *queue, struct DSQueueWaiters *waiters,
+                    struct DSQueueSelectNode *node);
+
+static void
+ds_queue_select_remove(struct DSQueue *queue,
+                       struct DSQueueWaiters *waiters,
+                       struct DSQueueSelectNode *node);
+
+static void
+ds_queue_select_notify(struct DSQueueWaiters *waiters);
+
+static bool
+ds_queue_backoff(struct DSQueue *queue, size_t *round,
+                 const struct timespec *deadline);
+
+static bool
+ds_queue_deadline_passed(const struct timespec *deadline);
+
+static void
+ds_queue_cpu_relax(void);
+
+static void
+ds_queue_cond_init(pthread_cond_t *cond);
+
+static void
+ds_queue_waiters_init(struct DSQueueWaiters *waiters);
+
+static void
+ds_queue_waiters_destroy(struct DSQueueWaiters *waiters);
+
+static void
+ds_queue_register(struct DSQueueWaiters *waiters);
+
+static void
+ds_queue_unregister(struct DSQueueWaiters *waiters);
+
+static bool
+ds_queue_wait(struct DSQueue *queue, struct DSQueueWaiters *waiters,
+              const struct timespec *deadline);
+
+static const struct timespec *
+ds_queue_deadline(struct timespec *deadline, uint64_t timeout_ns);
+
+static void
+ds_queue_wake(struct DSQueue *queue, struct DSQueueWaiters *waiters,
+              size_t count);
+
+static void
+ds_queue_wake_all(struct DSQueueWaiters *waiters);
 
 struct DSQueue *
-ds_queue_create(uint32_t buffer_capacity)
+ds_queue_create(size_t buffer_capacity)
 {
     struct DSQueue *queue;
-    int errno;
+    size_t i;
 
     assert(buffer_capacity > 0);
 
-    queue = malloc(sizeof(*queue));
-    assert(queue);
-
-    queue->pos = 0;
-    queue->length = 0;
+    queue = ds_queue_alloc();
     queue->capacity = buffer_capacity;
-    queue->closed = false;
 
     queue->buf = malloc(buffer_capacity * sizeof(*queue->buf));
     assert(queue->buf);
 
-    if (0 != (errno = pthread_mutex_init(&queue->mutate, NULL))) {
-        fprintf(stderr, "Could not create mutex. Errno: %d\n", errno);
-        exit(1);
-    }
-    if (0 != (errno = pthread_cond_init(&queue->cond_length, NULL))) {
-        fprintf(stderr, "Could not create cond var. Errno: %d\n", errno);
-        exit(1);
+    for (i = 0; i < buffer_capacity; ++i) {
+        queue->buf[i].seq = 2 * i;
+        queue->buf[i].item = NULL;
     }
 
     return queue;
 }
 
+struct DSQueue *
+ds_queue_create_unbounded(size_t segment_capacity)
+{
+    struct DSQueue *queue;
+
+    assert(segment_capacity > 0);
+
+    queue = ds_queue_alloc();
+    queue->capacity = (size_t) -1;
+    queue->seg_capacity = segment_capacity;
+    queue->tail_seg = ds_queue_segment_create(segment_capacity);
+    queue->head_seg = queue->tail_seg;
+
+    return queue;
+}
+
 void
 ds_queue_free(struct DSQueue *queue)
 {
+    struct DSQueueSegment *seg;
     int errno;
 
     if (0 != (errno = pthread_mutex_destroy(&queue->mutate))) {
         fprintf(stderr, "Could not destroy mutex. Errno: %d\n", errno);
         exit(1);
     }
-    if (0 != (errno = pthread_cond_destroy(&queue->cond_length))) {
-        fprintf(stderr, "Could not destroy cond var. Errno: %d\n", errno);
-        exit(1);
+    ds_queue_waiters_destroy(&queue->not_full);
+    ds_queue_waiters_destroy(&queue->not_empty);
+
+    /* Once no thread is using the queue, every segment that is still
+     * allocated is linked from the one being gotten from. */
+    while (queue->head_seg != NULL) {
+        seg = queue->head_seg;
+        queue->head_seg = seg->next;
+        free(seg);
     }
     free(queue->buf);
     free(queue);
 }
 
-int
+size_t
 ds_queue_length(struct DSQueue *queue)
 {
-    int len;
-    pthread_mutex_lock(&queue->mutate);
-    len = queue->length;
-    pthread_mutex_unlock(&queue->mutate);
-    return len;
+    size_t head, tail;
+
+    if (queue->seg_capacity > 0)
+        return ds_queue_seg_length(queue);
+
+    /* Reading the get position first means the put position can't be
+     * behind it. The result is a snapshot that may be stale at once. */
+    head = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+    tail = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE);
+
+    if (tail - head > queue->capacity)
+        return queue->capacity;
+    return tail - head;
 }
 
-int
+size_t
 ds_queue_capacity(struct DSQueue *queue)
 {
     return queue->capacity;
 }
 
 void
-ds_queue_close(struct DSQueue *queue)
+ds_queue_set_high_water(struct DSQueue *queue, size_t mark,
+                        void (*func)(struct DSQueue *queue, size_t length,
+                                     void *data),
+                        void *data)
 {
-    pthread_mutex_lock(&queue->mutate);
-    queue->closed = true;
-    pthread_cond_broadcast(&queue->cond_length);
-    pthread_mutex_unlock(&queue->mutate);
+    assert(queue->seg_capacity > 0);
+    assert(mark == 0 || func != NULL);
+
+    /* Only called before the queue is shared, so plain stores will do. */
+    queue->high_water = mark;
+    queue->high_water_func = func;
+    queue->high_water_data = data;
+    queue->above_high_water = false;
 }
 
 void
-ds_queue_put(struct DSQueue *queue, void *item)
+ds_queue_set_backoff(struct DSQueue *queue, size_t spins, size_t yields)
 {
-    pthread_mutex_lock(&queue->mutate);
-    assert(!queue->closed);
+    __atomic_store_n(&queue->spins, spins, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue->yields, yields, __ATOMIC_RELAXED);
+}
 
-    while (queue->length == queue->capacity)
-        pthread_cond_wait(&queue->cond_length, &queue->mutate);
+void
+ds_queue_close(struct DSQueue *queue)
+{
+    size_t round;
 
-    assert(!queue->closed);
-    assert(queue->length < queue->capacity);
+    pthread_mutex_lock(&queue->mutate);
+    __atomic_store_n(&queue->closed, true, __ATOMIC_SEQ_CST);
+    ds_queue_wake_all(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutate);
 
-    queue->buf[(queue->pos + queue->length) % queue->capacity] = item;
-    queue->length++;
-    pthread_cond_broadcast(&queue->cond_length);
+    /* A put that saw the queue open before the store above may still be
+     * adding its items. They must be in the queue before consumers are
+     * told that it is closed, or a consumer's last try could miss them.
+     * Those puts never block, so this wait is short. */
+    round = 0;
+    while (__atomic_load_n(&queue->producers, __ATOMIC_SEQ_CST) > 0)
+        ds_queue_snooze(&round);
 
+    pthread_mutex_lock(&queue->mutate);
+    __atomic_store_n(&queue->sealed, true, __ATOMIC_SEQ_CST);
+    ds_queue_wake_all(&queue->not_empty);
     pthread_mutex_unlock(&queue->mutate);
 }
 
+int
+ds_queue_put(struct DSQueue *queue, void *item)
+{
+    size_t done;
+
+    return ds_queue_put_until(queue, &item, 1, &done, NULL);
+}
+
 void *
 ds_queue_get(struct DSQueue *queue)
 {
     void *item;
+    size_t count;
+
+    if (DS_QUEUE_OK != ds_queue_get_until(queue, &item, 1, &count, NULL))
+        return NULL;
+
+    return item;
+}
+
+size_t
+ds_queue_put_many(struct DSQueue *queue, void **items, size_t n)
+{
+    size_t done;
+
+    ds_queue_put_until(queue, items, n, &done, NULL);
+
+    return done;
+}
+
+size_t
+ds_queue_get_many(struct DSQueue *queue, void **items, size_t max)
+{
+    size_t count;
+
+    ds_queue_get_until(queue, items, max, &count, NULL);
+
+    return count;
+}
+
+int
+ds_queue_try_put(struct DSQueue *queue, void *item)
+{
+    size_t count;
+
+    if (!ds_queue_try_push_open(queue, &item, 1, &count))
+        return DS_QUEUE_CLOSED;
+    if (count == 0)
+        return DS_QUEUE_FULL;
+
+    ds_queue_wake(queue, &queue->not_empty, 1);
+
+    return DS_QUEUE_OK;
+}
+
+int
+ds_queue_try_get(struct DSQueue *queue, void **item)
+{
+    if (ds_queue_try_pop_many(queue, item, 1) == 0) {
+        if (!__atomic_load_n(&queue->sealed, __ATOMIC_SEQ_CST))
+            return DS_QUEUE_EMPTY;
+
+        /* as in ds_queue_get_until, a last try after seeing the close */
+        if (ds_queue_try_pop_many(queue, item, 1) == 0)
+            return DS_QUEUE_CLOSED;
+    }
+
+    ds_queue_wake(queue, &queue->not_full, 1);
+
+    return DS_QUEUE_OK;
+}
+
+int
+ds_queue_put_timeout(struct DSQueue *queue, void *item, uint64_t timeout_ns)
+{
+    struct timespec deadline;
+    size_t done;
+
+    return ds_queue_put_until(queue, &item, 1, &done,
+                              ds_queue_deadline(&deadline, timeout_ns));
+}
+
+int
+ds_queue_get_timeout(struct DSQueue *queue, void **item, uint64_t timeout_ns)
+{
+    struct timespec deadline;
+    size_t count;
+
+    return ds_queue_get_until(queue, item, 1, &count,
+                              ds_queue_deadline(&deadline, timeout_ns));
+}
+
+int
+ds_queue_select_get(struct DSQueue **queues, size_t n, size_t *index,
+                    void **item, uint64_t timeout_ns)
+{
+    return ds_queue_select(queues, n, index, item, timeout_ns, false);
+}
+
+int
+ds_queue_select_put(struct DSQueue **queues, size_t n, size_t *index,
+                    void *item, uint64_t timeout_ns)
+{
+    return ds_queue_select(queues, n, index, &item, timeout_ns, true);
+}
+
+/* Puts the 'n' items, blocking while the queue is full, and sets 'done' to
+ * how many were put. Returns DS_QUEUE_OK once all of them are, or stops
+ * early with DS_QUEUE_CLOSED if the queue is closed, or DS_QUEUE_TIMEOUT
+ * if 'deadline' (on CLOCK_MONOTONIC) passes. A NULL deadline never
+ * passes. */
+static int
+ds_queue_put_until(struct DSQueue *queue, void **items, size_t n,
+                   size_t *done, const struct timespec *deadline)
+{
+    size_t count, round;
+    int status;
+
+    *done = 0;
+    if (!ds_queue_try_push_open(queue, items, n, done))
+        return DS_QUEUE_CLOSED;
+    if (*done > 0)
+        ds_queue_wake(queue, &queue->not_empty, *done);
+
+    round = 0;
+    while (*done < n) {
+        if (ds_queue_backoff(queue, &round, deadline)) {
+            if (!ds_queue_try_push_open(queue, items + *done, n - *done,
+                                        &count))
+                return DS_QUEUE_CLOSED;
+            if (count > 0) {
+                *done += count;
+                ds_queue_wake(queue, &queue->not_empty, count);
+                round = 0;
+            }
+            continue;
+        }
+
+        /* The queue is full, so wait for a get to make room. Registering
+         * as a waiter before trying again means that a get which misses
+         * the registration must have happened before the retry, which will
+         * then see the room it made. */
+        status = DS_QUEUE_OK;
+        pthread_mutex_lock(&queue->mutate);
+        for (;;) {
+            ds_queue_register(&queue->not_full);
+
+            /* Closing the queue wakes every waiting producer, to give up
+             * here rather than wait for room that may never come, and
+             * without adding to the closed queue. */
+            if (!ds_queue_try_push_open(queue, items + *done, n - *done,
+                                        &count)) {
+                ds_queue_unregister(&queue->not_full);
+                status = DS_QUEUE_CLOSED;
+                break;
+            }
+            if (count > 0) {
+                ds_queue_unregister(&queue->not_full);
+                break;
+            }
+
+            if (!ds_queue_wait(queue, &queue->not_full, deadline)) {
+                status = DS_QUEUE_TIMEOUT;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&queue->mutate);
+
+        if (status != DS_QUEUE_OK)
+            return status;
+
+        *done += count;
+        ds_queue_wake(queue, &queue->not_empty, count);
+        round = 0;
+    }
+
+    return DS_QUEUE_OK;
+}
+
+/* Gets up to 'max' items, blocking while the queue is empty, and sets
+ * 'count' to how many were gotten. Returns DS_QUEUE_OK as soon as there
+ * is at least one, DS_QUEUE_CLOSED if the queue is closed and empty, or
+ * DS_QUEUE_TIMEOUT if 'deadline' passes first. */
+static int
+ds_queue_get_until(struct DSQueue *queue, void **items, size_t max,
+                   size_t *count, const struct timespec *deadline)
+{
+    size_t round;
+    int status;
+
+    *count = 0;
+    if (max == 0)
+        return DS_QUEUE_OK;
+
+    *count = ds_queue_try_pop_many(queue, items, max);
+
+    round = 0;
+    while (*count == 0
+           && !__atomic_load_n(&queue->sealed, __ATOMIC_ACQUIRE)
+           && ds_queue_backoff(queue, &round, deadline))
+        *count = ds_queue_try_pop_many(queue, items, max);
+
+    if (*count == 0) {
+        status = DS_QUEUE_OK;
+        pthread_mutex_lock(&queue->mutate);
+        for (;;) {
+            ds_queue_register(&queue->not_empty);
+
+            *count = ds_queue_try_pop_many(queue, items, max);
+            if (*count > 0) {
+                ds_queue_unregister(&queue->not_empty);
+                break;
+            }
+
+            /* This is a bit tricky. It is possible that the queue has been
+             * closed *and* has become empty while `pthread_cond_wait` is
+             * blocking. Therefore, it is necessary to always check if the
+             * queue has been closed when the queue is empty, otherwise we
+             * will deadlock. The queue is only sealed once every put that
+             * got in before the close has finished, so one last try sees
+             * all of them. */
+            if (__atomic_load_n(&queue->sealed, __ATOMIC_SEQ_CST)) {
+                ds_queue_unregister(&queue->not_empty);
+                *count = ds_queue_try_pop_many(queue, items, max);
+                if (*count == 0)
+                    status = DS_QUEUE_CLOSED;
+                break;
+            }
+
+            if (!ds_queue_wait(queue, &queue->not_empty, deadline)) {
+                status = DS_QUEUE_TIMEOUT;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&queue->mutate);
+
+        if (status != DS_QUEUE_OK)
+            return status;
+    }
+
+    ds_queue_wake(queue, &queue->not_full, *count);
+
+    return DS_QUEUE_OK;
+}
+
+/* Gets from (or puts into) the first of the queues that is ready, blocking
+ * until one is, or until the timeout passes.
+ *
+ * A blocked select links a node into the waiters of each of its queues,
+ * so that any put (get) on one of them notifies it. As with a single
+ * queue, it registers before its last try, and the fence in ds_queue_wake
+ * means that either the waker sees the registration, or the try sees what
+ * the waker did. The selector stays registered until it returns, so
+ * every try after a notification is covered too. */
+static int
+ds_queue_select(struct DSQueue **queues, size_t n, size_t *index,
+                void **item, uint64_t timeout_ns, bool put)
+{
+    struct DSQueueSelector selector;
+    struct DSQueueSelectNode *nodes;
+    struct timespec deadline_buf;
+    const struct timespec *deadline;
+    size_t start, i;
+    int status, errno;
+
+    assert(n > 0);
+
+    start = __atomic_fetch_add(&ds_queue_select_start, 1, __ATOMIC_RELAXED);
+    status = ds_queue_select_try(queues, n, start, index, item, put);
+    if (status != DS_QUEUE_TIMEOUT || timeout_ns == 0)
+        return status;
+
+    deadline = ds_queue_deadline(&deadline_buf, timeout_ns);
+
+    if (0 != (errno = pthread_mutex_init(&selector.mutate, NULL))) {
+        fprintf(stderr, "Could not create mutex. Errno: %d\n", errno);
+        exit(1);
+    }
+    ds_queue_cond_init(&selector.cond);
+    selector.ready = false;
+
+    nodes = malloc(n * sizeof(*nodes));
+    assert(nodes);
+
+    for (i = 0; i < n; ++i) {
+        nodes[i].selector = &selector;
+        ds_queue_select_add(queues[i], put ? &queues[i]->not_full
+                                           : &queues[i]->not_empty,
+                            &nodes[i]);
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
+    for (;;) {
+        status = ds_queue_select_try(queues, n, start, index, item, put);
+        if (status != DS_QUEUE_TIMEOUT)
+            break;
+
+        pthread_mutex_lock(&selector.mutate);
+        while (!selector.ready) {
+            if (deadline == NULL) {
+                pthread_cond_wait(&selector.cond, &selector.mutate);
+            } else if (0 != pthread_cond_timedwait(&selector.cond,
+                                                   &selector.mutate,
+                                                   deadline)) {
+                break;
+            }
+        }
+        if (!selector.ready) {
+            pthread_mutex_unlock(&selector.mutate);
+            break;
+        }
+        selector.ready = false;
+        pthread_mutex_unlock(&selector.mutate);
+    }
+
+    for (i = 0; i < n; ++i)
+        ds_queue_select_remove(queues[i], put ? &queues[i]->not_full
+                                              : &queues[i]->not_empty,
+                               &nodes[i]);
+    free(nodes);
+
+    pthread_mutex_destroy(&selector.mutate);
+    pthread_cond_destroy(&selector.cond);
+
+    return status;
+}
+
+/* Tries each queue once, without blocking, starting from queues[start % n].
+ * Returns DS_QUEUE_OK or DS_QUEUE_CLOSED for the first queue that was
+ * ready, and sets 'index' to it, or returns DS_QUEUE_TIMEOUT if none
+ * was. */
+static int
+ds_queue_select_try(struct DSQueue **queues, size_t n, size_t start,
+                    size_t *index, void **item, bool put)
+{
+    size_t i, j;
+    int status;
+
+    for (i = 0; i < n; ++i) {
+        j = (start + i) % n;
+        if (put)
+            status = ds_queue_try_put(queues[j], *item);
+        else
+            status = ds_queue_try_get(queues[j], item);
+
+        if (status == DS_QUEUE_OK || status == DS_QUEUE_CLOSED) {
+            *index = j;
+            return status;
+        }
+    }
+
+    return DS_QUEUE_TIMEOUT;
+}
+
+static void
+ds_queue_select_add(struct DSQueue *queue, struct DSQueueWaiters *waiters,
+                    struct DSQueueSelectNode *node)
+{
+    pthread_mutex_lock(&queue->mutate);
+    node->prev = NULL;
+    node->next = waiters->selects;
+    if (waiters->selects != NULL)
+        waiters->selects->prev = node;
+    waiters->selects = node;
+    __atomic_add_fetch(&waiters->selecting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->mutate);
+}
+
+static void
+ds_queue_select_remove(struct DSQueue *queue,
+                       struct DSQueueWaiters *waiters,
+                       struct DSQueueSelectNode *node)
+{
     pthread_mutex_lock(&queue->mutate);
+    if (node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        waiters->selects = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    __atomic_sub_fetch(&waiters->selecting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->mutate);
+}
+
+/* Notifies every selector waiting on one side of a queue. The caller holds
+ * the queue's `mutate`. */
+static void
+ds_queue_select_notify(struct DSQueueWaiters *waiters)
+{
+    struct DSQueueSelectNode *node;
+    struct DSQueueSelector *selector;
+
+    for (node = waiters->selects; node != NULL; node = node->next) {
+        selector = node->selector;
+        pthread_mutex_lock(&selector->mutate);
+        selector->ready = true;
+        pthread_cond_signal(&selector->cond);
+        pthread_mutex_unlock(&selector->mutate);
+    }
+}
+
+/* Puts up to 'n' items without blocking, and returns how many were put
+ * (0 if the queue is full).
+ *
+ * This is Dmitry Vyukov's bounded MPMC queue, extended to batches: a
+ * producer checks the sequence numbers of the cells from `enqueue_pos` on,
+ * and claims the run of free ones by advancing `enqueue_pos` past them
+ * with a single CAS. Since only the owner of a position can fill its cell,
+ * the cells stay free once claimed. Publishing each item is then a store
+ * to its sequence number, so producers and consumers only contend on their
+ * own position, and never wait on each other. */
+static size_t
+ds_queue_try_push_many(struct DSQueue *queue, void **items, size_t n)
+{
+    struct DSQueueCell *cell;
+    size_t pos, seq, count, i;
+    intptr_t dif;
+
+    if (queue->seg_capacity > 0) {
+        for (i = 0; i < n; ++i)
+            ds_queue_seg_push(queue, items[i]);
+        return n;
+    }
+
+    if (n == 0)
+        return 0;
+
+    pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        dif = 0;
+        for (count = 0; count < n && count < queue->capacity; ++count) {
+            cell = &queue->buf[(pos + count) % queue->capacity];
+            seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+            dif = (intptr_t) seq - (intptr_t) (2 * (pos + count));
+            if (dif != 0)
+                break;
+        }
+
+        if (count > 0) {
+            if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos,
+                                            pos + count, false,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            /* the item from a lap ago hasn't been gotten yet */
+            return 0;
+        } else {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    for (i = 0; i < count; ++i) {
+        cell = &queue->buf[(pos + i) % queue->capacity];
+        cell->item = items[i];
+        __atomic_store_n(&cell->seq, 2 * (pos + i) + 1, __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
+
+/* Puts up to 'n' items with ds_queue_try_push_many and sets 'count' to how
+ * many were put, unless the queue has been closed, in which case nothing
+ * is put and false is returned.
+ *
+ * The put counts itself in `producers` before it checks `closed`, and
+ * ds_queue_close sets `closed` before it checks `producers`. So either the
+ * put sees the close and backs out, or the close sees the put and waits
+ * for it to publish its items before sealing the queue. */
+static bool
+ds_queue_try_push_open(struct DSQueue *queue, void **items, size_t n,
+                       size_t *count)
+{
+    __atomic_add_fetch(&queue->producers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->closed, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&queue->producers, 1, __ATOMIC_RELEASE);
+        *count = 0;
+        return false;
+    }
+
+    *count = ds_queue_try_push_many(queue, items, n);
+    __atomic_sub_fetch(&queue->producers, 1, __ATOMIC_RELEASE);
+
+    return true;
+}
 
-    while (queue->length == 0) {
-        /* This is a bit tricky. It is possible that the queue has been closed
-         * *and* has become empty while `pthread_cond_wait` is blocking.
-         * Therefore, it is necessary to always check if the queue has been
-         * closed when the queue is empty, otherwise we will deadlock. */
-        if (queue->closed) {
-            pthread_mutex_unlock(&queue->mutate);
-            return NULL;
+/* Gets up to 'max' items without blocking, and returns how many were
+ * gotten (0 if the queue is empty). The mirror image of
+ * ds_queue_try_push_many. */
+static size_t
+ds_queue_try_pop_many(struct DSQueue *queue, void **items, size_t max)
+{
+    struct DSQueueCell *cell;
+    size_t pos, seq, count, i;
+    intptr_t dif;
+
+    if (queue->seg_capacity > 0) {
+        for (i = 0; i < max && ds_queue_seg_pop(queue, &items[i]); ++i)
+            ;
+        return i;
+    }
+
+    if (max == 0)
+        return 0;
+
+    pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        dif = 0;
+        for (count = 0; count < max && count < queue->capacity; ++count) {
+            cell = &queue->buf[(pos + count) % queue->capacity];
+            seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+            dif = (intptr_t) seq - (intptr_t) (2 * (pos + count) + 1);
+            if (dif != 0)
+                break;
+        }
+
+        if (count > 0) {
+            if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos,
+                                            pos + count, false,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            /* nothing has been put at this position yet */
+            return 0;
+        } else {
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    for (i = 0; i < count; ++i) {
+        cell = &queue->buf[(pos + i) % queue->capacity];
+        items[i] = cell->item;
+        cell->item = NULL;
+        __atomic_store_n(&cell->seq, 2 * (pos + i + queue->capacity),
+                         __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
+
+/* Allocates a queue with everything but its storage set up. */
+static struct DSQueue *
+ds_queue_alloc(void)
+{
+    struct DSQueue *queue;
+    int errno;
+
+    queue = malloc(sizeof(*queue));
+    assert(queue);
+
+    queue->buf = NULL;
+    queue->capacity = 0;
+    queue->seg_capacity = 0;
+    queue->high_water = 0;
+    queue->high_water_func = NULL;
+    queue->high_water_data = NULL;
+    queue->above_high_water = false;
+
+    /* With one CPU, the thread being waited for can't run while we spin. */
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1)
+        queue->spins = DS_QUEUE_SPINS;
+    else
+        queue->spins = 0;
+    queue->yields = DS_QUEUE_YIELDS;
+    queue->enqueue_pos = 0;
+    queue->tail_seg = NULL;
+    queue->dequeue_pos = 0;
+    queue->head_seg = NULL;
+    queue->producers = 0;
+    queue->closed = false;
+    queue->sealed = false;
+
+    if (0 != (errno = pthread_mutex_init(&queue->mutate, NULL))) {
+        fprintf(stderr, "Could not create mutex. Errno: %d\n", errno);
+        exit(1);
+    }
+    ds_queue_waiters_init(&queue->not_full);
+    ds_queue_waiters_init(&queue->not_empty);
+
+    return queue;
+}
+
+static struct DSQueueSegment *
+ds_queue_segment_create(size_t capacity)
+{
+    struct DSQueueSegment *seg;
+    size_t i;
+
+    seg = malloc(sizeof(*seg) + (capacity - 1) * sizeof(seg->slots[0]));
+    assert(seg);
+
+    seg->next = NULL;
+    for (i = 0; i < capacity; ++i) {
+        seg->slots[i].item = NULL;
+        seg->slots[i].state = 0;
+    }
+
+    return seg;
+}
+
+/* Frees a drained segment once the items in slots 'start' on have all been
+ * taken. A slot whose reader hasn't finished yet is marked instead, and
+ * its reader carries on from there. The reader of the last slot starts
+ * this, since no thread can reach the segment once the get position has
+ * moved past it. */
+static void
+ds_queue_segment_release(struct DSQueueSegment *seg, size_t start,
+                         size_t capacity)
+{
+    struct DSQueueSlot *slot;
+    size_t i;
+
+    for (i = start; i + 1 < capacity; ++i) {
+        slot = &seg->slots[i];
+        if (!(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)
+              & DS_QUEUE_SLOT_READ)
+            && !(__atomic_fetch_or(&slot->state, DS_QUEUE_SLOT_DESTROY,
+                                   __ATOMIC_ACQ_REL)
+                 & DS_QUEUE_SLOT_READ))
+            return;
+    }
+    free(seg);
+}
+
+/* Puts an item into an unbounded queue. This never fails, and never waits
+ * on a get.
+ *
+ * It is the segmented queue of crossbeam's SegQueue. Each segment spans
+ * seg_capacity + 1 positions: one for each slot, and one more that stands
+ * for the move to the next segment. A producer claims a position with a
+ * CAS, and fills its slot. The one that claims the last slot has already
+ * allocated the next segment, and links it in by publishing the segment
+ * and then the first position in it. Until then, the position is the
+ * extra one, and other producers wait briefly for the move to finish.
+ *
+ * Since the get position only passes a segment once all of its slots are
+ * claimed, a producer that claimed a position can use its segment without
+ * it being freed from under it. */
+static void
+ds_queue_seg_push(struct DSQueue *queue, void *item)
+{
+    struct DSQueueSegment *seg, *next;
+    struct DSQueueSlot *slot;
+    size_t cap, tail, offset, round;
+
+    cap = queue->seg_capacity;
+    next = NULL;
+    round = 0;
+
+    tail = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE);
+    seg = __atomic_load_n(&queue->tail_seg, __ATOMIC_ACQUIRE);
+    for (;;) {
+        offset = (tail >> DS_QUEUE_SHIFT) % (cap + 1);
+        if (offset == cap) {
+            /* another producer is moving to the next segment */
+            ds_queue_snooze(&round);
+            tail = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE);
+            seg = __atomic_load_n(&queue->tail_seg, __ATOMIC_ACQUIRE);
+            continue;
         }
-        pthread_cond_wait(&queue->cond_length, &queue->mutate);
+
+        /* Allocate before claiming the last slot, so that the others wait
+         * on the move for as short a time as possible. */
+        if (offset + 1 == cap && next == NULL)
+            next = ds_queue_segment_create(cap);
+
+        if (__atomic_compare_exchange_n(&queue->enqueue_pos, &tail,
+                                        tail + (1 << DS_QUEUE_SHIFT), false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+            break;
+        seg = __atomic_load_n(&queue->tail_seg, __ATOMIC_ACQUIRE);
     }
 
-    assert(queue->length <= queue->capacity);
-    assert(queue->length > 0);
+    if (offset + 1 == cap) {
+        __atomic_store_n(&queue->tail_seg, next, __ATOMIC_RELEASE);
+        __atomic_store_n(&queue->enqueue_pos, tail + (2 << DS_QUEUE_SHIFT),
+                         __ATOMIC_RELEASE);
+        __atomic_store_n(&seg->next, next, __ATOMIC_RELEASE);
+        next = NULL;
+    }
 
-    item = queue->buf[queue->pos];
-    queue->buf[queue->pos] = NULL;
-    queue->pos = (queue->pos + 1) % queue->capacity;
+    slot = &seg->slots[offset];
+    slot->item = item;
+    __atomic_fetch_or(&slot->state, DS_QUEUE_SLOT_WRITTEN, __ATOMIC_RELEASE);
 
-    queue->length--;
-    pthread_cond_broadcast(&queue->cond_length);
+    /* lost the race for the last slot after allocating */
+    free(next);
 
+    if (offset + 1 == cap)
+        ds_queue_high_water_check(queue, true);
+}
+
+/* Gets an item from an unbounded queue if there is one. The mirror image
+ * of ds_queue_seg_push, except that the consumer of the last slot of a
+ * segment moves on to the next one, which the producers have linked in by
+ * then, and starts freeing the drained segment.
+ *
+ * Only a position that a producer has claimed is taken, but its item may
+ * not be stored yet, in which case this waits briefly for it. As long as
+ * the get position is in the last segment, that is checked against the
+ * put position. Once a later segment exists, DS_QUEUE_HAS_NEXT is set in
+ * the get position, and consumers don't read the put position at all. */
+static bool
+ds_queue_seg_pop(struct DSQueue *queue, void **item)
+{
+    struct DSQueueSegment *seg, *next;
+    struct DSQueueSlot *slot;
+    size_t cap, head, new_head, tail, offset, round;
+
+    cap = queue->seg_capacity;
+    round = 0;
+
+    head = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+    seg = __atomic_load_n(&queue->head_seg, __ATOMIC_ACQUIRE);
+    for (;;) {
+        offset = (head >> DS_QUEUE_SHIFT) % (cap + 1);
+        if (offset == cap) {
+            ds_queue_snooze(&round);
+            head = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+            seg = __atomic_load_n(&queue->head_seg, __ATOMIC_ACQUIRE);
+            continue;
+        }
+
+        new_head = head + (1 << DS_QUEUE_SHIFT);
+        if (!(new_head & DS_QUEUE_HAS_NEXT)) {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            tail = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+            if (head >> DS_QUEUE_SHIFT == tail >> DS_QUEUE_SHIFT)
+                return false;
+            if ((head >> DS_QUEUE_SHIFT) / (cap + 1)
+                != (tail >> DS_QUEUE_SHIFT) / (cap + 1))
+                new_head |= DS_QUEUE_HAS_NEXT;
+        }
+
+        if (__atomic_compare_exchange_n(&queue->dequeue_pos, &head,
+                                        new_head, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+            break;
+        seg = __atomic_load_n(&queue->head_seg, __ATOMIC_ACQUIRE);
+    }
+
+    if (offset + 1 == cap) {
+        round = 0;
+        while (NULL == (next = __atomic_load_n(&seg->next, __ATOMIC_ACQUIRE)))
+            ds_queue_snooze(&round);
+
+        new_head = (new_head & ~(size_t) DS_QUEUE_HAS_NEXT)
+                   + (1 << DS_QUEUE_SHIFT);
+        if (NULL != __atomic_load_n(&next->next, __ATOMIC_RELAXED))
+            new_head |= DS_QUEUE_HAS_NEXT;
+
+        __atomic_store_n(&queue->head_seg, next, __ATOMIC_RELEASE);
+        __atomic_store_n(&queue->dequeue_pos, new_head, __ATOMIC_RELEASE);
+    }
+
+    slot = &seg->slots[offset];
+    round = 0;
+    while (!(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)
+             & DS_QUEUE_SLOT_WRITTEN))
+        ds_queue_snooze(&round);
+    *item = slot->item;
+
+    if (offset + 1 == cap) {
+        ds_queue_segment_release(seg, 0, cap);
+        ds_queue_high_water_check(queue, false);
+    } else if (__atomic_fetch_or(&slot->state, DS_QUEUE_SLOT_READ,
+                                 __ATOMIC_ACQ_REL)
+               & DS_QUEUE_SLOT_DESTROY) {
+        ds_queue_segment_release(seg, offset + 1, cap);
+    }
+
+    return true;
+}
+
+/* The length of an unbounded queue. Each segment spans one position more
+ * than it has slots, so the number of items before position p is
+ * p - p / (seg_capacity + 1), once a position on the extra one is rounded
+ * up to the next segment. */
+static size_t
+ds_queue_seg_length(struct DSQueue *queue)
+{
+    size_t lap, head, tail;
+
+    lap = queue->seg_capacity + 1;
+
+    /* a consistent pair: the put position didn't move while reading */
+    for (;;) {
+        tail = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_SEQ_CST);
+        head = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&queue->enqueue_pos, __ATOMIC_SEQ_CST) == tail)
+            break;
+    }
+
+    head >>= DS_QUEUE_SHIFT;
+    tail >>= DS_QUEUE_SHIFT;
+    if (head % lap == lap - 1)
+        ++head;
+    if (tail % lap == lap - 1)
+        ++tail;
+
+    return (tail - tail / lap) - (head - head / lap);
+}
+
+/* Rearms the high water mark function if the queue has drained below the
+ * mark, or, when a producer has just 'filled' a segment, calls it if the
+ * queue has grown to the mark. So it is only ever called by producers.
+ * To keep this off the fast path, it is only checked when a segment fills
+ * up or drains, so the mark is noticed within a segment's worth of
+ * items. */
+static void
+ds_queue_high_water_check(struct DSQueue *queue, bool filled)
+{
+    size_t mark, length;
+
+    mark = __atomic_load_n(&queue->high_water, __ATOMIC_ACQUIRE);
+    if (mark == 0)
+        return;
+
+    length = ds_queue_seg_length(queue);
+    if (length < mark) {
+        if (__atomic_load_n(&queue->above_high_water, __ATOMIC_RELAXED))
+            __atomic_store_n(&queue->above_high_water, false,
+                             __ATOMIC_RELAXED);
+    } else if (filled
+               && !__atomic_exchange_n(&queue->above_high_water, true,
+                                       __ATOMIC_ACQ_REL)) {
+        queue->high_water_func(queue, length, queue->high_water_data);
+    }
+}
+
+/* Waits on another thread that is in the middle of a step: briefly by
+ * spinning, and then by yielding the CPU, in case that thread isn't
+ * running. */
+static void
+ds_queue_snooze(size_t *round)
+{
+    if (*round < 64)
+        ds_queue_cpu_relax();
+    else
+        sched_yield();
+    ++*round;
+}
+
+/* Waits a little before the next try on a full (or empty) queue, and
+ * returns true, or returns false once the queue's budget of spins and
+ * yields is used up, or 'deadline' (if not NULL) has passed, and the
+ * caller should block. 'round' counts the tries so far, starting from 0.
+ *
+ * The first `spins` rounds only pause the CPU briefly, which catches a
+ * producer (consumer) that is already on its way, within a fraction of a
+ * microsecond. The next `yields` rounds give up the CPU, but stay
+ * runnable, which still costs less than blocking and being woken. */
+static bool
+ds_queue_backoff(struct DSQueue *queue, size_t *round,
+                 const struct timespec *deadline)
+{
+    if (deadline != NULL && ds_queue_deadline_passed(deadline))
+        return false;
+
+    if (*round < __atomic_load_n(&queue->spins, __ATOMIC_RELAXED)) {
+        ds_queue_cpu_relax();
+    } else if (*round < __atomic_load_n(&queue->spins, __ATOMIC_RELAXED)
+                        + __atomic_load_n(&queue->yields, __ATOMIC_RELAXED)) {
+        sched_yield();
+    } else {
+        return false;
+    }
+    ++*round;
+
+    return true;
+}
+
+static bool
+ds_queue_deadline_passed(const struct timespec *deadline)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec > deadline->tv_sec
+           || (now.tv_sec == deadline->tv_sec
+               && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/* Tells the CPU that this is a spin loop, which saves power and frees the
+ * core for its sibling hyperthread. */
+static void
+ds_queue_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Creates a condition variable that times waits on CLOCK_MONOTONIC, so
+ * that timeouts are not thrown off by changes to the system time. */
+static void
+ds_queue_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    int errno;
+
+    if (0 != (errno = pthread_condattr_init(&attr))
+        || 0 != (errno = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC))) {
+        fprintf(stderr, "Could not set cond var clock. Errno: %d\n", errno);
+        exit(1);
+    }
+    if (0 != (errno = pthread_cond_init(cond, &attr))) {
+        fprintf(stderr, "Could not create cond var. Errno: %d\n", errno);
+        exit(1);
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+static void
+ds_queue_waiters_init(struct DSQueueWaiters *waiters)
+{
+    waiters->waiting = 0;
+    waiters->wakeups = 0;
+    waiters->selects = NULL;
+    waiters->selecting = 0;
+
+    ds_queue_cond_init(&waiters->cond);
+}
+
+static void
+ds_queue_waiters_destroy(struct DSQueueWaiters *waiters)
+{
+    int errno;
+
+    if (0 != (errno = pthread_cond_destroy(&waiters->cond))) {
+        fprintf(stderr, "Could not destroy cond var. Errno: %d\n", errno);
+        exit(1);
+    }
+}
+
+/* Counts the calling thread as about to block, before it makes its last
+ * try. The caller holds `mutate`, and keeps it until it either takes
+ * itself off the count (the try worked) or is inside pthread_cond_wait.
+ * The fence pairs with the one in ds_queue_wake: either the waker sees the
+ * count, or the last try sees what the waker did. */
+static void
+ds_queue_register(struct DSQueueWaiters *waiters)
+{
+    __atomic_add_fetch(&waiters->waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void
+ds_queue_unregister(struct DSQueueWaiters *waiters)
+{
+    __atomic_sub_fetch(&waiters->waiting, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Blocks until a wakeup is handed out, takes it and returns true. The
+ * caller holds `mutate` and has registered. Once woken, it is no longer
+ * counted, and must register again before its next try.
+ *
+ * If 'deadline' is not NULL and passes first, the caller takes itself off
+ * the count instead, and false is returned. */
+static bool
+ds_queue_wait(struct DSQueue *queue, struct DSQueueWaiters *waiters,
+              const struct timespec *deadline)
+{
+    while (waiters->wakeups == 0) {
+        if (deadline == NULL) {
+            pthread_cond_wait(&waiters->cond, &queue->mutate);
+        } else if (0 != pthread_cond_timedwait(&waiters->cond,
+                                               &queue->mutate, deadline)) {
+            /* a wakeup may have been handed out as the wait timed out */
+            if (waiters->wakeups > 0)
+                break;
+            ds_queue_unregister(waiters);
+            return false;
+        }
+    }
+    --waiters->wakeups;
+
+    return true;
+}
+
+/* Sets 'deadline' to 'timeout_ns' nanoseconds from now, on the
+ * CLOCK_MONOTONIC clock that the condition variables wait on, and returns
+ * it. Returns NULL, for no deadline, if 'timeout_ns' is DS_QUEUE_FOREVER. */
+static const struct timespec *
+ds_queue_deadline(struct timespec *deadline, uint64_t timeout_ns)
+{
+    uint64_t nsec;
+
+    if (timeout_ns == DS_QUEUE_FOREVER)
+        return NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    nsec = (uint64_t) deadline->tv_nsec + timeout_ns % 1000000000;
+    deadline->tv_sec += (time_t) (timeout_ns / 1000000000 + nsec / 1000000000);
+    deadline->tv_nsec = (long) (nsec % 1000000000);
+
+    return deadline;
+}
+
+/* Wakes as many of the waiters as there are new items (or new room), after
+ * 'count' items have been put (or gotten). Nothing is done unless someone
+ * is waiting, and then only threads on the right side are woken, one
+ * signal each, rather than everyone being woken to fight over one item.
+ * Selecting threads are all notified, since each may be about to pick
+ * another queue. */
+static void
+ds_queue_wake(struct DSQueue *queue, struct DSQueueWaiters *waiters,
+              size_t count)
+{
+    size_t waiting;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiters->waiting, __ATOMIC_RELAXED) == 0
+        && __atomic_load_n(&waiters->selecting, __ATOMIC_RELAXED) == 0)
+        return;
+
+    pthread_mutex_lock(&queue->mutate);
+    ds_queue_select_notify(waiters);
+    waiting = __atomic_load_n(&waiters->waiting, __ATOMIC_RELAXED);
+    if (count > waiting)
+        count = waiting;
+
+    __atomic_store_n(&waiters->waiting, waiting - count, __ATOMIC_SEQ_CST);
+    waiters->wakeups += count;
+    for (; count > 0; --count)
+        pthread_cond_signal(&waiters->cond);
     pthread_mutex_unlock(&queue->mutate);
+}
 
-    return item;
+/* Wakes every waiter, as when the queue is closed. The caller holds
+ * `mutate`. */
+static void
+ds_queue_wake_all(struct DSQueueWaiters *waiters)
+{
+    waiters->wakeups += __atomic_load_n(&waiters->waiting, __ATOMIC_RELAXED);
+    __atomic_store_n(&waiters->waiting, 0, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&waiters->cond);
+    ds_queue_select_notify(waiters);
 }
@@ -1,6 +1,7 @@
 #ifndef __LIBDS_QUEUE_H__
 #define __LIBDS_QUEUE_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 /*
@@ -9,13 +10,48 @@
  * That is, it supports a multiple producer and multiple consumer model.
  */
 
-/* DSQueue implements a thread-safe queue using a fairly standard
- * circular buffer. */
+/* DSQueue implements a thread-safe queue using a lock-free circular
+ * buffer, in which every slot carries a sequence number that says whether
+ * it is ready to be put into or gotten from. Putting and getting only
+ * touch the mutex when the queue is full or empty and a thread has to
+ * block. Producers waiting for room and consumers waiting for items wait
+ * apart, and each put (get) wakes at most one waiting consumer (producer)
+ * per item (slot) it made available. */
 struct DSQueue;
 
+/* The results of the queue operations that can fail rather than block,
+ * or give up blocking. */
+#define DS_QUEUE_OK 0
+#define DS_QUEUE_FULL 1     /* there was no room to put the value */
+#define DS_QUEUE_EMPTY 2    /* there was no value to get */
+#define DS_QUEUE_TIMEOUT 3  /* the timeout passed while blocking */
+#define DS_QUEUE_CLOSED 4   /* the queue is closed (and, for gets, empty) */
+
+/* A timeout that never passes. */
+#define DS_QUEUE_FOREVER ((uint64_t) -1)
+
+/* The default number of times a thread spins, and then yields the CPU,
+ * before blocking on a full or empty queue. See `ds_queue_set_backoff`. */
+#define DS_QUEUE_SPINS 100
+#define DS_QUEUE_YIELDS 10
+
 /* Allocates a new DSQueue with a buffer size of the capacity given. */
 struct DSQueue *
-ds_queue_create(uint32_t buffer_capacity);
+ds_queue_create(size_t buffer_capacity);
+
+/* Allocates a new unbounded DSQueue: one that is never full, so puts never
+ * block. It stores items in a linked list of segments of
+ * 'segment_capacity' slots each, which are allocated as the queue grows
+ * and freed as soon as consumers have drained them, so the memory used
+ * follows the length of the queue, a segment at a time.
+ *
+ * Putting and getting stay lock-free apart from the move from one segment
+ * to the next, where the threads that get there at the same moment wait
+ * briefly for the one making the move. A get may also wait briefly for a
+ * put that has claimed its slot but not yet stored its item. Larger
+ * segments make both rarer, and the allocations fewer. */
+struct DSQueue *
+ds_queue_create_unbounded(size_t segment_capacity);
 
 /* Frees all data used to create a DSQueue. It should only be called after
  * a call to ds_queue_close to make sure all 'gets' are terminated before
@@ -26,15 +62,54 @@ void
 ds_queue_free(struct DSQueue *queue);
 
 /* Returns the current length (number of items) in the queue. */
-int
+size_t
 ds_queue_length(struct DSQueue *queue);
 
 /* Returns the capacity of the queue. This is always equivalent to the
- * size of the initial buffer capacity. */
-int
+ * size of the initial buffer capacity, or (size_t) -1 for an unbounded
+ * queue. */
+size_t
 ds_queue_capacity(struct DSQueue *queue);
 
-/* Closes a queue. A closed queue cannot add any new values.
+/* Sets how a thread that finds the queue full (or empty) waits for it to
+ * change. It first retries 'spins' times, pausing the CPU briefly between
+ * tries, which picks up a value put a fraction of a microsecond later
+ * without any system call. Then it retries 'yields' times, yielding the
+ * CPU to other threads between tries. Only then does it block, and have
+ * to be woken by the other side, which costs a system call on both sides
+ * and a trip through the scheduler.
+ *
+ * Spinning burns CPU time that other threads could have used, so it only
+ * pays off when the other side is running on another CPU and the gap is
+ * short. The defaults are DS_QUEUE_SPINS and DS_QUEUE_YIELDS, except that
+ * there is no spinning on a machine with one CPU. Setting both to 0 makes
+ * threads block straight away. */
+void
+ds_queue_set_backoff(struct DSQueue *queue, size_t spins, size_t yields);
+
+/* Sets a soft high water mark on an unbounded queue: 'func' is called with
+ * the queue, its length and 'data' when the queue grows to 'mark' items,
+ * and then not again until it has drained below the mark. It is meant for
+ * telemetry, or for producers to start shedding load, and is only ever
+ * called by a producer, from within a put. Consumers only rearm it.
+ *
+ * The mark is soft in that the length is only checked as segments fill up
+ * and drain, so it is noticed within a segment's worth of items. A 'mark'
+ * of 0 turns this off.
+ *
+ * This must be called before the queue is shared with other threads: the
+ * mark, 'func' and 'data' are read without synchronization afterwards. */
+void
+ds_queue_set_high_water(struct DSQueue *queue, size_t mark,
+                        void (*func)(struct DSQueue *queue, size_t length,
+                                     void *data),
+                        void *data);
+
+/* Closes a queue. A closed queue cannot add any new values: puts fail
+ * with DS_QUEUE_CLOSED, including those blocked on a full queue when it is
+ * closed. A put that races with the close either fails, or adds its value
+ * before `ds_queue_close` returns: every value whose put returned
+ * DS_QUEUE_OK is gotten by some get.
  *
  * When a queue is closed, an empty queue will always be empty.
  * Therefore, `ds_queue_get` will return NULL and not block when
@@ -49,11 +124,11 @@ void
 ds_queue_close(struct DSQueue *queue);
 
 /* Adds new values to a queue (or "sends values to a consumer").
- * `ds_queue_put` cannot be called with a queue that has been closed. If
- * it is, an assertion error will occur. 
  * If the queue is full, `ds_queue_put` will block until it is not full,
- * in which case the value will be added to the queue. */
-void
+ * in which case the value will be added to the queue and DS_QUEUE_OK is
+ * returned. If the queue has been closed, nothing is added and
+ * DS_QUEUE_CLOSED is returned. */
+int
 ds_queue_put(struct DSQueue *queue, void *item);
 
 /* Reads new values from a queue (or "receives values from a producer").
@@ -67,4 +142,81 @@ ds_queue_put(struct DSQueue *queue, void *item);
 void *
 ds_queue_get(struct DSQueue *queue);
 
+/* Adds the 'n' values in 'items' to a queue, in order, as if by calling
+ * `ds_queue_put` on each. As many as there is room for are claimed at once
+ * with a single atomic update, and waiting consumers are woken once per
+ * such batch rather than once per item. Blocks while the queue is full
+ * until every value has been added, and returns how many were added,
+ * which is less than 'n' only if the queue was closed. */
+size_t
+ds_queue_put_many(struct DSQueue *queue, void **items, size_t n);
+
+/* Reads up to 'max' values from a queue into 'items', in order, and
+ * returns how many were read. Like `ds_queue_get`, it blocks while the
+ * queue is empty, but it returns as soon as there is at least one value,
+ * taking all those available (up to 'max') with a single atomic update.
+ * If the queue is closed and empty, 0 is returned immediately. */
+size_t
+ds_queue_get_many(struct DSQueue *queue, void **items, size_t max);
+
+/* Adds a value to the queue if there is room, without blocking. Returns
+ * DS_QUEUE_OK if it was added, DS_QUEUE_FULL if the queue is full, or
+ * DS_QUEUE_CLOSED if the queue has been closed. */
+int
+ds_queue_try_put(struct DSQueue *queue, void *item);
+
+/* Reads the next value into '*item' if there is one, without blocking.
+ * Returns DS_QUEUE_OK if a value was read, DS_QUEUE_EMPTY if the queue is
+ * empty, or DS_QUEUE_CLOSED if it is closed and empty. */
+int
+ds_queue_try_get(struct DSQueue *queue, void **item);
+
+/* Like `ds_queue_put`, but blocks for at most 'timeout_ns' nanoseconds
+ * (measured on CLOCK_MONOTONIC, and DS_QUEUE_FOREVER for no limit), and
+ * returns DS_QUEUE_TIMEOUT without adding the value if the queue is still
+ * full by then. */
+int
+ds_queue_put_timeout(struct DSQueue *queue, void *item, uint64_t timeout_ns);
+
+/* Like `ds_queue_try_get`, but blocks for at most 'timeout_ns' nanoseconds
+ * while the queue is empty, and returns DS_QUEUE_TIMEOUT if no value came
+ * by then. */
+int
+ds_queue_get_timeout(struct DSQueue *queue, void **item, uint64_t timeout_ns);
+
+/* Gets a value from whichever of the 'n' queues has one first, like Go's
+ * `select` statement with a receive from each. Blocks until one of them
+ * has a value or is closed and empty, for at most 'timeout_ns'
+ * nanoseconds (DS_QUEUE_FOREVER to wait as long as it takes, 0 to only
+ * poll them). Returns:
+ *
+ *  DS_QUEUE_OK, with the value read from queues[*index] put in '*item';
+ *  DS_QUEUE_CLOSED, if queues[*index] is closed and empty (take it out of
+ *      the array, or every later select will pick it at once);
+ *  DS_QUEUE_TIMEOUT, if the timeout passed first.
+ *
+ * When several queues are ready, the one to use is picked in turn, so
+ * that none is starved. A single thread can serve many queues this way:
+ *
+ *  while (n > 0) {
+ *      if (DS_QUEUE_OK == ds_queue_select_get(queues, n, &i, &item,
+ *                                             DS_QUEUE_FOREVER))
+ *          handle(i, item);
+ *      else
+ *          queues[i] = queues[--n];
+ *  }
+ *
+ * A blocked select does not poll: it registers with every queue, and
+ * sleeps until a put to (or the closing of) any of them notifies it. */
+int
+ds_queue_select_get(struct DSQueue **queues, size_t n, size_t *index,
+                    void **item, uint64_t timeout_ns);
+
+/* Puts 'item' into whichever of the 'n' queues has room first, in the same
+ * way. Returns DS_QUEUE_OK once it is in queues[*index], DS_QUEUE_CLOSED
+ * (without putting it) if queues[*index] is closed, or DS_QUEUE_TIMEOUT. */
+int
+ds_queue_select_put(struct DSQueue **queues, size_t n, size_t *index,
+                    void *item, uint64_t timeout_ns);
+
 #endif
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+
+#include "segvector.h"
+
+/* private function to add a chunk to the end of a segmented vector */
+static void
+ds_segvector_add_chunk(struct DSSegVector *vec);
+
+struct DSSegVector *
+ds_segvector_create()
+{
+    return ds_segvector_create_shift(DS_SEGVECTOR_CHUNK_SHIFT);
+}
+
+struct DSSegVector *
+ds_segvector_create_shift(unsigned shift)
+{
+    struct DSSegVector *vec;
+
+    assert(shift < sizeof(size_t) * 8 - 4);
+
+    vec = malloc(sizeof(*vec));
+    assert(vec);
+
+    vec->size = 0;
+    vec->shift = shift;
+    vec->mask = ((size_t) 1 << shift) - 1;
+
+    vec->nchunks = 0;
+    vec->dir_capacity = DS_SEGVECTOR_BASE_CHUNKS;
+    vec->chunks = malloc(vec->dir_capacity * sizeof(*vec->chunks));
+    assert(vec->chunks);
+
+    return vec;
+}
+
+void
+ds_segvector_free(struct DSSegVector *vec)
+{
+    size_t i;
+
+    for (i = 0; i < vec->size; ++i)
+        free(DS_SEGVECTOR_AT(vec, i));
+
+    ds_segvector_free_no_data(vec);
+}
+
+void
+ds_segvector_free_no_data(struct DSSegVector *vec)
+{
+    size_t i;
+
+    for (i = 0; i < vec->nchunks; ++i)
+        free(vec->chunks[i]);
+
+    free(vec->chunks);
+    free(vec);
+}
+
+void
+ds_segvector_append(struct DSSegVector *vec, void *data)
+{
+    if ((vec->size >> vec->shift) == vec->nchunks)
+        ds_segvector_add_chunk(vec);
+
+    DS_SEGVECTOR_AT(vec, vec->size) = data;
+    ++vec->size;
+}
+
+void *
+ds_segvector_pop(struct DSSegVector *vec)
+{
+    if (vec->size == 0)
+        return NULL;
+
+    --vec->size;
+    return DS_SEGVECTOR_AT(vec, vec->size);
+}
+
+void *
+ds_segvector_get(struct DSSegVector *vec, size_t index)
+{
+    if (index >= vec->size)
+        return NULL;
+
+    return DS_SEGVECTOR_AT(vec, index);
+}
+
+void
+ds_segvector_set(struct DSSegVector *vec, void *data, size_t index)
+{
+    if (index >= vec->size)
+        return;
+
+    DS_SEGVECTOR_AT(vec, index) = data;
+}
+
+void **
+ds_segvector_at(struct DSSegVector *vec, size_t index)
+{
+    if (index >= vec->size)
+        return NULL;
+
+    return &DS_SEGVECTOR_AT(vec, index);
+}
+
+void
+ds_segvector_shrink_to_fit(struct DSSegVector *vec)
+{
+    size_t used;
+
+    /* the number of chunks holding at least one element */
+    used = (vec->size + vec->mask) >> vec->shift;
+
+    while (vec->nchunks > used)
+        free(vec->chunks[--vec->nchunks]);
+}
+
+void
+ds_segvector_map(struct DSSegVector *vec, void (func)(void*))
+{
+    size_t c, i, left;
+
+    /* walk each chunk directly rather than re-splitting every index */
+    left = vec->size;
+    for (c = 0; left > 0; ++c) {
+        void **chunk;
+        size_t n;
+
+        chunk = vec->chunks[c];
+        n = left < vec->mask + 1 ? left : vec->mask + 1;
+
+        for (i = 0; i < n; ++i)
+            func(chunk[i]);
+
+        left -= n;
+    }
+}
+
+static void
+ds_segvector_add_chunk(struct DSSegVector *vec)
+{
+    void **chunk;
+
+    if (vec->nchunks == vec->dir_capacity) {
+        vec->dir_capacity *= 2;
+        vec->chunks = realloc(vec->chunks,
+                              vec->dir_capacity * sizeof(*vec->chunks));
+        assert(vec->chunks);
+    }
+
+    chunk = malloc((vec->mask + 1) * sizeof(*chunk));
+    assert(chunk);
+
+    vec->chunks[vec->nchunks++] = chunk;
+}
@@ -0,0 +1,118 @@
+#ifndef __LIBDS_SEGVECTOR_H__
+#define __LIBDS_SEGVECTOR_H__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* some private constants for segmented vector tuning */
+static const unsigned DS_SEGVECTOR_CHUNK_SHIFT = 10;
+static const size_t DS_SEGVECTOR_BASE_CHUNKS = 8;
+
+/**
+ * A DSSegVector stores its elements in fixed size chunks of 2^shift
+ * elements, reached through a small directory of chunk pointers.
+ *
+ * Unlike DSVector, growing never moves existing elements: a full vector
+ * just gets another chunk. So the address of an element (ds_segvector_at)
+ * stays valid until the element is popped or the vector is freed, and no
+ * append ever copies the data. The only thing that is ever reallocated is
+ * the directory, which is 2^shift times smaller than the data.
+ */
+struct DSSegVector {
+    size_t size;
+
+    /* Each chunk holds (1 << shift) elements, 'mask' is (1 << shift) - 1. */
+    unsigned shift;
+    size_t mask;
+
+    /* The directory. The first 'nchunks' entries point to allocated chunks,
+     * and there is room for 'dir_capacity' entries. */
+    void ***chunks;
+    size_t nchunks;
+    size_t dir_capacity;
+};
+
+/**
+ * Evaluates to the element at index i as an lvalue, without any bounds
+ * checking. Useful in hot loops where a function call per element is
+ * too much.
+ */
+#define DS_SEGVECTOR_AT(vec, i) \
+    ((vec)->chunks[(i) >> (vec)->shift][(i) & (vec)->mask])
+
+/**
+ * Creates a segmented vector with chunks of 2^DS_SEGVECTOR_CHUNK_SHIFT
+ * elements. ds_segvector_free or ds_segvector_free_no_data will need to be
+ * called when done with the vector to avoid memory leaks.
+ */
+struct DSSegVector *
+ds_segvector_create();
+
+/**
+ * Creates a segmented vector with chunks of 2^shift elements.
+ */
+struct DSSegVector *
+ds_segvector_create_shift(unsigned shift);
+
+/**
+ * Free's a segmented vector AND its data.
+ */
+void
+ds_segvector_free(struct DSSegVector *vec);
+
+/**
+ * Free's just the segmented vector's representation. Data is NOT freed.
+ */
+void
+ds_segvector_free_no_data(struct DSSegVector *vec);
+
+/**
+ * Adds an element to the end of a segmented vector.
+ * Existing elements are never moved.
+ */
+void
+ds_segvector_append(struct DSSegVector *vec, void *data);
+
+/**
+ * Removes the last element of a segmented vector and returns it.
+ * Returns NULL if the vector is empty. Does *NOT* free the data.
+ * The chunk the element lived in is kept for later appends.
+ */
+void *
+ds_segvector_pop(struct DSSegVector *vec);
+
+/**
+ * Gets an element at index i from a segmented vector.
+ */
+void *
+ds_segvector_get(struct DSSegVector *vec, size_t index);
+
+/**
+ * Sets an element at index to data.
+ * No data is freed.
+ */
+void
+ds_segvector_set(struct DSSegVector *vec, void *data, size_t index);
+
+/**
+ * Returns the address of the element at index i, or NULL if index is out
+ * of bounds. The address stays valid until the element is popped or the
+ * vector is freed.
+ */
+void **
+ds_segvector_at(struct DSSegVector *vec, size_t index);
+
+/**
+ * Releases chunks that no longer hold any elements.
+ */
+void
+ds_segvector_shrink_to_fit(struct DSSegVector *vec);
+
+/**
+ * Higher-order function to map func over every element in the vector.
+ */
+void
+ds_segvector_map(struct DSSegVector *vec, void (func)(void*));
+
+#endif
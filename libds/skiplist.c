@@ -0,0 +1,685 @@
+#include <stdlib.h>
+
+#include "skiplist.h"
+
+/* private helper functions */
+static struct DSSkipList *
+ds_skiplist_create_mode(int32_t (*compare)(void*, void*), bool concurrent,
+                        void (*free_data)(void*));
+
+static void
+ds_skiplist_free_nodes(struct DSSkipList *sl, bool free_data);
+
+static struct DSSkipNode *
+ds_skiplist_node_create(void *data, size_t level);
+
+static size_t
+ds_skiplist_random_level(struct DSSkipList *sl);
+
+static struct DSSkipNode *
+ds_skiplist_load(struct DSSkipNode **link);
+
+static bool
+ds_skiplist_cas(struct DSSkipNode **link, struct DSSkipNode **expected,
+                struct DSSkipNode *desired);
+
+static bool
+ds_skiplist_is_marked(struct DSSkipNode *link);
+
+static struct DSSkipNode *
+ds_skiplist_marked(struct DSSkipNode *link);
+
+static struct DSSkipNode *
+ds_skiplist_unmarked(struct DSSkipNode *link);
+
+static void
+ds_skiplist_concurrent_find(struct DSSkipList *sl, void *key,
+                            bool after_equal, struct DSSkipNode **preds,
+                            struct DSSkipNode **succs);
+
+static void
+ds_skiplist_concurrent_unlink(struct DSSkipList *sl, void *key);
+
+static void
+ds_skiplist_concurrent_insert(struct DSSkipList *sl, void *data);
+
+static void *
+ds_skiplist_concurrent_remove(struct DSSkipList *sl, void *key,
+                              size_t epoch);
+
+static void
+ds_skiplist_retire(struct DSSkipList *sl, struct DSSkipNode *node,
+                   size_t epoch);
+
+static void
+ds_skiplist_reclaim(struct DSSkipList *sl);
+
+static void
+ds_skiplist_free_retired(struct DSSkipList *sl, struct DSSkipNode *node);
+
+struct DSSkipList *
+ds_skiplist_create(int32_t (*compare)(void*, void*))
+{
+    return ds_skiplist_create_mode(compare, false, NULL);
+}
+
+struct DSSkipList *
+ds_skiplist_create_concurrent(int32_t (*compare)(void*, void*),
+                              void (*free_data)(void*))
+{
+    return ds_skiplist_create_mode(compare, true, free_data);
+}
+
+static struct DSSkipList *
+ds_skiplist_create_mode(int32_t (*compare)(void*, void*), bool concurrent,
+                        void (*free_data)(void*))
+{
+    struct DSSkipList *sl;
+    size_t i;
+
+    sl = malloc(sizeof(*sl));
+    assert(sl);
+
+    sl->length = 0;
+    sl->compare = compare;
+    sl->level = 1;
+    sl->head = ds_skiplist_node_create(NULL, DS_SKIPLIST_MAX_LEVEL);
+    sl->seed = (uint64_t) (uintptr_t) sl;
+    sl->concurrent = concurrent;
+    sl->free_data = free_data;
+    sl->epoch = 0;
+    for (i = 0; i < DS_SKIPLIST_EPOCHS; ++i) {
+        sl->readers[i] = 0;
+        sl->limbo[i] = NULL;
+    }
+    sl->reclaiming = false;
+
+    return sl;
+}
+
+void
+ds_skiplist_free(struct DSSkipList *sl)
+{
+    ds_skiplist_free_nodes(sl, true);
+}
+
+void
+ds_skiplist_free_no_data(struct DSSkipList *sl)
+{
+    ds_skiplist_free_nodes(sl, false);
+}
+
+static void
+ds_skiplist_free_nodes(struct DSSkipList *sl, bool free_data)
+{
+    struct DSSkipNode *node, *next;
+    size_t i;
+
+    /* Removed nodes are freed from the limbo lists, so they are skipped
+     * if they happen to still be linked. */
+    node = sl->head->next[0];
+    while (node != NULL) {
+        next = ds_skiplist_unmarked(node->next[0]);
+        if (!ds_skiplist_is_marked(node->next[0])) {
+            if (free_data)
+                free(node->data);
+            free(node);
+        }
+        node = next;
+    }
+
+    for (i = 0; i < DS_SKIPLIST_EPOCHS; ++i)
+        ds_skiplist_free_retired(sl, sl->limbo[i]);
+
+    free(sl->head);
+    free(sl);
+}
+
+void
+ds_skiplist_insert(struct DSSkipList *sl, void *data)
+{
+    struct DSSkipNode *update[DS_SKIPLIST_MAX_LEVEL];
+    struct DSSkipNode *node;
+    size_t i, level, guard;
+
+    if (sl->concurrent) {
+        guard = ds_skiplist_enter(sl);
+        ds_skiplist_concurrent_insert(sl, data);
+        ds_skiplist_leave(sl, guard);
+        return;
+    }
+
+    /* find the last node of each level that goes before 'data' */
+    node = sl->head;
+    for (i = sl->level; i-- > 0;) {
+        while (node->next[i] != NULL
+               && sl->compare(data, node->next[i]->data) >= 0)
+            node = node->next[i];
+        update[i] = node;
+    }
+
+    level = ds_skiplist_random_level(sl);
+    for (; sl->level < level; ++sl->level)
+        update[sl->level] = sl->head;
+
+    node = ds_skiplist_node_create(data, level);
+    for (i = 0; i < level; ++i) {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+
+    ++sl->length;
+}
+
+void *
+ds_skiplist_find(struct DSSkipList *sl, void *key)
+{
+    struct DSSkipNode *node;
+    void *data;
+    size_t guard;
+
+    guard = ds_skiplist_enter(sl);
+    node = ds_skiplist_lower_bound(sl, key);
+    if (node == NULL || sl->compare(key, node->data) != 0)
+        data = NULL;
+    else
+        data = node->data;
+    ds_skiplist_leave(sl, guard);
+
+    return data;
+}
+
+void *
+ds_skiplist_remove(struct DSSkipList *sl, void *key)
+{
+    struct DSSkipNode *update[DS_SKIPLIST_MAX_LEVEL];
+    struct DSSkipNode *node;
+    void *data;
+    size_t i, guard;
+
+    if (sl->concurrent) {
+        guard = ds_skiplist_enter(sl);
+        data = ds_skiplist_concurrent_remove(sl, key, guard);
+        ds_skiplist_leave(sl, guard);
+
+        if (data != NULL)
+            ds_skiplist_reclaim(sl);
+        return data;
+    }
+
+    node = sl->head;
+    for (i = sl->level; i-- > 0;) {
+        while (node->next[i] != NULL
+               && sl->compare(key, node->next[i]->data) > 0)
+            node = node->next[i];
+        update[i] = node;
+    }
+
+    node = node->next[0];
+    if (node == NULL || sl->compare(key, node->data) != 0)
+        return NULL;
+
+    /* Being the first equal node of the list, it is also the first equal
+     * node of each of its levels. */
+    for (i = 0; i < node->level; ++i)
+        update[i]->next[i] = node->next[i];
+
+    while (sl->level > 1 && sl->head->next[sl->level - 1] == NULL)
+        --sl->level;
+
+    data = node->data;
+    free(node);
+    --sl->length;
+
+    return data;
+}
+
+/* A reader is counted under the epoch it read, and then checks that the
+ * epoch hasn't moved on in the meantime, or else backs out and tries
+ * again. So once the epoch has moved on twice, nobody is left reading
+ * under the first one. */
+size_t
+ds_skiplist_enter(struct DSSkipList *sl)
+{
+    size_t epoch;
+
+    if (!sl->concurrent)
+        return 0;
+
+    for (;;) {
+        epoch = __atomic_load_n(&sl->epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&sl->readers[epoch % DS_SKIPLIST_EPOCHS], 1,
+                           __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&sl->epoch, __ATOMIC_SEQ_CST) == epoch)
+            return epoch;
+        __atomic_sub_fetch(&sl->readers[epoch % DS_SKIPLIST_EPOCHS], 1,
+                           __ATOMIC_RELEASE);
+    }
+}
+
+void
+ds_skiplist_leave(struct DSSkipList *sl, size_t guard)
+{
+    if (!sl->concurrent)
+        return;
+
+    __atomic_sub_fetch(&sl->readers[guard % DS_SKIPLIST_EPOCHS], 1,
+                       __ATOMIC_RELEASE);
+}
+
+struct DSSkipNode *
+ds_skiplist_first(struct DSSkipList *sl)
+{
+    return ds_skiplist_next(sl, sl->head);
+}
+
+/* This serves both kinds of lists. Nodes are never marked in a list that
+ * isn't concurrent, and the atomic loads are plain loads on most CPUs. */
+struct DSSkipNode *
+ds_skiplist_lower_bound(struct DSSkipList *sl, void *key)
+{
+    struct DSSkipNode *pred, *curr, *succ;
+    size_t i;
+
+    pred = sl->head;
+    curr = NULL;
+    for (i = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE); i-- > 0;) {
+        curr = ds_skiplist_unmarked(ds_skiplist_load(&pred->next[i]));
+        while (curr != NULL) {
+            succ = ds_skiplist_load(&curr->next[i]);
+            if (ds_skiplist_is_marked(succ))
+                curr = ds_skiplist_unmarked(succ);
+            else if (sl->compare(key, curr->data) > 0) {
+                pred = curr;
+                curr = succ;
+            } else
+                break;
+        }
+    }
+
+    return curr;
+}
+
+struct DSSkipNode *
+ds_skiplist_next(struct DSSkipList *sl, struct DSSkipNode *node)
+{
+    struct DSSkipNode *next, *succ;
+
+    (void) sl;
+
+    next = ds_skiplist_unmarked(ds_skiplist_load(&node->next[0]));
+    while (next != NULL) {
+        succ = ds_skiplist_load(&next->next[0]);
+        if (!ds_skiplist_is_marked(succ))
+            break;
+        next = ds_skiplist_unmarked(succ);
+    }
+
+    return next;
+}
+
+void
+ds_skiplist_range(struct DSSkipList *sl, void *low, void *high,
+                  void (func)(void*))
+{
+    struct DSSkipNode *node;
+    size_t guard;
+
+    guard = ds_skiplist_enter(sl);
+    for (node = ds_skiplist_lower_bound(sl, low);
+         node != NULL && sl->compare(node->data, high) <= 0;
+         node = ds_skiplist_next(sl, node))
+        func(node->data);
+    ds_skiplist_leave(sl, guard);
+}
+
+void
+ds_skiplist_map(struct DSSkipList *sl, void (func)(void*))
+{
+    struct DSSkipNode *node;
+    size_t guard;
+
+    guard = ds_skiplist_enter(sl);
+    for (node = ds_skiplist_first(sl); node != NULL;
+         node = ds_skiplist_next(sl, node))
+        func(node->data);
+    ds_skiplist_leave(sl, guard);
+}
+
+static struct DSSkipNode *
+ds_skiplist_node_create(void *data, size_t level)
+{
+    struct DSSkipNode *node;
+    size_t i;
+
+    node = malloc(sizeof(*node) + (level - 1) * sizeof(node->next[0]));
+    assert(node);
+
+    node->data = data;
+    node->level = level;
+    node->retired = NULL;
+    for (i = 0; i < level; ++i)
+        node->next[i] = NULL;
+
+    return node;
+}
+
+/* Picks a level with probability 1/4 of going up each time. The bits come
+ * from splitmix64 on a counter, which gives every thread of a concurrent
+ * list its own value without a lock. */
+static size_t
+ds_skiplist_random_level(struct DSSkipList *sl)
+{
+    uint64_t z;
+    size_t level;
+
+    if (sl->concurrent)
+        z = __atomic_add_fetch(&sl->seed, 1, __ATOMIC_RELAXED);
+    else
+        z = ++sl->seed;
+
+    z *= (uint64_t) 0x9e3779b9 << 32 | 0x7f4a7c15;
+    z = (z ^ (z >> 30)) * ((uint64_t) 0xbf58476d << 32 | 0x1ce4e5b9);
+    z = (z ^ (z >> 27)) * ((uint64_t) 0x94d049bb << 32 | 0x133111eb);
+    z ^= z >> 31;
+
+    for (level = 1; level < DS_SKIPLIST_MAX_LEVEL && (z & 3) == 0; ++level)
+        z >>= 2;
+
+    return level;
+}
+
+/* In a concurrent list, the lowest bit of a node's next[i] is set once the
+ * node is being removed, which stops anything else from being linked in
+ * after it at that level. */
+static struct DSSkipNode *
+ds_skiplist_load(struct DSSkipNode **link)
+{
+    return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+static bool
+ds_skiplist_cas(struct DSSkipNode **link, struct DSSkipNode **expected,
+                struct DSSkipNode *desired)
+{
+    return __atomic_compare_exchange_n(link, expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static bool
+ds_skiplist_is_marked(struct DSSkipNode *link)
+{
+    return ((uintptr_t) link & 1) != 0;
+}
+
+static struct DSSkipNode *
+ds_skiplist_marked(struct DSSkipNode *link)
+{
+    return (struct DSSkipNode *) ((uintptr_t) link | 1);
+}
+
+static struct DSSkipNode *
+ds_skiplist_unmarked(struct DSSkipNode *link)
+{
+    return (struct DSSkipNode *) ((uintptr_t) link & ~(uintptr_t) 1);
+}
+
+/* Finds, at every level in use, the last node before the position of 'key'
+ * ('preds') and the node after it ('succs'). The position is before any
+ * equal elements, or after them if 'after_equal' is true.
+ * Marked nodes met on the way are unlinked; if another thread changes a
+ * link first, the search starts over. */
+static void
+ds_skiplist_concurrent_find(struct DSSkipList *sl, void *key,
+                            bool after_equal, struct DSSkipNode **preds,
+                            struct DSSkipNode **succs)
+{
+    struct DSSkipNode *pred, *curr, *succ, *expected;
+    int32_t cmp;
+    size_t i;
+
+retry:
+    pred = sl->head;
+    for (i = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE); i-- > 0;) {
+        curr = ds_skiplist_unmarked(ds_skiplist_load(&pred->next[i]));
+        while (curr != NULL) {
+            succ = ds_skiplist_load(&curr->next[i]);
+            if (ds_skiplist_is_marked(succ)) {
+                expected = curr;
+                if (!ds_skiplist_cas(&pred->next[i], &expected,
+                                     ds_skiplist_unmarked(succ)))
+                    goto retry;
+                curr = ds_skiplist_unmarked(succ);
+                continue;
+            }
+
+            cmp = sl->compare(key, curr->data);
+            if (cmp < 0 || (cmp == 0 && !after_equal))
+                break;
+
+            pred = curr;
+            curr = succ;
+        }
+
+        preds[i] = pred;
+        succs[i] = curr;
+    }
+}
+
+/* Unlinks every marked node equal to 'key' from every level, which the
+ * search does not do: it stops at the first equal node, or goes past them
+ * all and so starts the next level down after them. Since a node may be
+ * linked in after equal nodes at a higher level, but before them at the
+ * bottom, the equal nodes are swept at every level. */
+static void
+ds_skiplist_concurrent_unlink(struct DSSkipList *sl, void *key)
+{
+    struct DSSkipNode *pred, *prev, *curr, *succ, *expected;
+    int32_t cmp;
+    size_t i;
+
+retry:
+    pred = sl->head;
+    for (i = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE); i-- > 0;) {
+        /* 'pred' stops before the equal nodes, and 'prev' goes past them */
+        prev = pred;
+        curr = ds_skiplist_unmarked(ds_skiplist_load(&prev->next[i]));
+        while (curr != NULL) {
+            succ = ds_skiplist_load(&curr->next[i]);
+            if (ds_skiplist_is_marked(succ)) {
+                expected = curr;
+                if (!ds_skiplist_cas(&prev->next[i], &expected,
+                                     ds_skiplist_unmarked(succ)))
+                    goto retry;
+                curr = ds_skiplist_unmarked(succ);
+                continue;
+            }
+
+            cmp = sl->compare(key, curr->data);
+            if (cmp < 0)
+                break;
+
+            prev = curr;
+            if (cmp > 0)
+                pred = curr;
+            curr = succ;
+        }
+    }
+}
+
+/* The node is linked into the bottom level first, which is when it joins
+ * the list, and then into the levels above it one by one.
+ *
+ * If the node is removed in the meantime, the remover's sweep may pass a
+ * level before the node is linked into it. Once the node is freed, that
+ * link would point at freed memory, so the inserter sweeps again (while
+ * the node can't be freed yet) to unlink it from every level. */
+static void
+ds_skiplist_concurrent_insert(struct DSSkipList *sl, void *data)
+{
+    struct DSSkipNode *preds[DS_SKIPLIST_MAX_LEVEL];
+    struct DSSkipNode *succs[DS_SKIPLIST_MAX_LEVEL];
+    struct DSSkipNode *node, *succ, *expected;
+    size_t i, level, top;
+
+    level = ds_skiplist_random_level(sl);
+
+    /* make sure searches start at least as high as the new node */
+    top = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE);
+    while (top < level
+           && !__atomic_compare_exchange_n(&sl->level, &top, level, false,
+                                           __ATOMIC_ACQ_REL,
+                                           __ATOMIC_ACQUIRE))
+        ;
+
+    node = ds_skiplist_node_create(data, level);
+
+    for (;;) {
+        ds_skiplist_concurrent_find(sl, data, true, preds, succs);
+        for (i = 0; i < level; ++i)
+            __atomic_store_n(&node->next[i], succs[i], __ATOMIC_RELAXED);
+
+        expected = succs[0];
+        if (ds_skiplist_cas(&preds[0]->next[0], &expected, node))
+            break;
+    }
+
+    __atomic_add_fetch(&sl->length, 1, __ATOMIC_RELAXED);
+
+    for (i = 1; i < level; ++i) {
+        for (;;) {
+            /* If the node is already being removed, it doesn't need to
+             * go any higher. */
+            succ = ds_skiplist_load(&node->next[i]);
+            if (ds_skiplist_is_marked(succ))
+                goto linked;
+            if (succ != succs[i] && !ds_skiplist_cas(&node->next[i], &succ,
+                                                     succs[i]))
+                goto linked;
+
+            expected = succs[i];
+            if (ds_skiplist_cas(&preds[i]->next[i], &expected, node))
+                break;
+
+            ds_skiplist_concurrent_find(sl, data, true, preds, succs);
+        }
+    }
+
+linked:
+    /* pairs with the fence after the remover marks the node */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ds_skiplist_is_marked(ds_skiplist_load(&node->next[0])))
+        ds_skiplist_concurrent_unlink(sl, data);
+}
+
+/* A node is removed by marking its links from the top level down. Whoever
+ * marks the bottom link has removed it; the node is then unlinked by a
+ * search for it, and retired under the remover's 'epoch'. */
+static void *
+ds_skiplist_concurrent_remove(struct DSSkipList *sl, void *key,
+                              size_t epoch)
+{
+    struct DSSkipNode *preds[DS_SKIPLIST_MAX_LEVEL];
+    struct DSSkipNode *succs[DS_SKIPLIST_MAX_LEVEL];
+    struct DSSkipNode *victim, *succ;
+    void *data;
+    size_t i;
+
+    for (;;) {
+        ds_skiplist_concurrent_find(sl, key, false, preds, succs);
+        victim = succs[0];
+        if (victim == NULL || sl->compare(key, victim->data) != 0)
+            return NULL;
+
+        for (i = victim->level; i-- > 1;) {
+            succ = ds_skiplist_load(&victim->next[i]);
+            while (!ds_skiplist_is_marked(succ)
+                   && !ds_skiplist_cas(&victim->next[i], &succ,
+                                       ds_skiplist_marked(succ)))
+                ;
+        }
+
+        succ = ds_skiplist_load(&victim->next[0]);
+        while (!ds_skiplist_is_marked(succ)) {
+            if (ds_skiplist_cas(&victim->next[0], &succ,
+                                ds_skiplist_marked(succ))) {
+                __atomic_sub_fetch(&sl->length, 1, __ATOMIC_RELAXED);
+
+                /* Either this sees every level the inserter linked, or
+                 * the inserter sees the mark and unlinks it itself. */
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                ds_skiplist_concurrent_unlink(sl, key);
+
+                data = victim->data;
+                ds_skiplist_retire(sl, victim, epoch);
+
+                return data;
+            }
+        }
+
+        /* another thread removed it first; look for another equal one */
+    }
+}
+
+/* Puts an unlinked node on the limbo list of the 'epoch' its remover is
+ * reading under. Nothing else is put there until the epoch has moved on
+ * three times, which can't happen while the remover is still reading. */
+static void
+ds_skiplist_retire(struct DSSkipList *sl, struct DSSkipNode *node,
+                   size_t epoch)
+{
+    struct DSSkipNode **limbo;
+
+    limbo = &sl->limbo[epoch % DS_SKIPLIST_EPOCHS];
+    node->retired = __atomic_load_n(limbo, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(limbo, &node->retired, node, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+/* Moves the epoch on, if nobody is left reading under the one before it,
+ * and frees the nodes removed two epochs back. No reader can have seen
+ * those: the epoch has moved on since they were retired, which needed
+ * every reader from before they were unlinked to be gone. Only one thread
+ * does this at a time, so the epoch can't move on again between taking
+ * the list and moving it. */
+static void
+ds_skiplist_reclaim(struct DSSkipList *sl)
+{
+    struct DSSkipNode *nodes;
+    size_t epoch;
+
+    if (__atomic_exchange_n(&sl->reclaiming, true, __ATOMIC_ACQUIRE))
+        return;
+
+    epoch = __atomic_load_n(&sl->epoch, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sl->readers[(epoch + DS_SKIPLIST_EPOCHS - 1)
+                                     % DS_SKIPLIST_EPOCHS],
+                        __ATOMIC_SEQ_CST) > 0) {
+        __atomic_store_n(&sl->reclaiming, false, __ATOMIC_RELEASE);
+        return;
+    }
+
+    /* the list of epoch - 2, which is also the list of epoch + 1 */
+    nodes = __atomic_exchange_n(&sl->limbo[(epoch + 1) % DS_SKIPLIST_EPOCHS],
+                                NULL, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&sl->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&sl->reclaiming, false, __ATOMIC_RELEASE);
+
+    ds_skiplist_free_retired(sl, nodes);
+}
+
+/* Frees a list of retired nodes, linked with 'retired', and their data. */
+static void
+ds_skiplist_free_retired(struct DSSkipList *sl, struct DSSkipNode *node)
+{
+    struct DSSkipNode *next;
+
+    while (node != NULL) {
+        next = node->retired;
+        if (sl->free_data != NULL)
+            sl->free_data(node->data);
+        free(node);
+        node = next;
+    }
+}
@@ -0,0 +1,227 @@
+#ifndef __LIBDS_SKIPLIST_H__
+#define __LIBDS_SKIPLIST_H__
+
+/* #define NDEBUG */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The most levels a skip list node can have. With one node in four
+ * promoted to each next level, 32 levels is plenty for any list that fits
+ * in memory. (A #define, since it sizes arrays.) */
+#define DS_SKIPLIST_MAX_LEVEL 32
+
+/* The number of epochs a concurrent list keeps apart when freeing removed
+ * nodes: the current one, the one before, and the one being freed. */
+#define DS_SKIPLIST_EPOCHS 3
+
+/**
+ * A DSSkipList keeps its elements sorted with respect to 'compare', which
+ * is defined as for ds_list_sort:
+ *      compare(a, b) < 0 when a < b
+ *      compare(a, b) = 0 when a = b
+ *      compare(a, b) > 0 when a > b
+ *
+ * Besides the sorted list of all elements, every node is linked into
+ * a random number of express lanes above it, each with about a quarter of
+ * the nodes of the lane below. Inserting, finding and removing take
+ * O(log n) expected time, and a range is scanned by finding its start and
+ * then following the list.
+ *
+ * Equal elements are allowed, and are kept in the order they were
+ * inserted.
+ *
+ * A list made with 'ds_skiplist_create_concurrent' may be used by many
+ * threads at once without locks. See there for the details.
+ */
+struct DSSkipList {
+    size_t length;
+    int32_t (*compare)(void*, void*);
+
+    /* The number of levels in use. Never more than DS_SKIPLIST_MAX_LEVEL. */
+    size_t level;
+
+    /* A node with no data and DS_SKIPLIST_MAX_LEVEL levels, which comes
+     * before every other node. */
+    struct DSSkipNode *head;
+
+    /* Feeds the random choice of each new node's level. */
+    uint64_t seed;
+
+    bool concurrent;
+
+    /* Frees the elements removed from a concurrent list, or NULL if the
+     * list doesn't own them. */
+    void (*free_data)(void*);
+
+    /* Epoch based reclamation, for a concurrent list. A thread that reads
+     * the list is counted in 'readers[epoch % DS_SKIPLIST_EPOCHS]' for the
+     * epoch it entered in, and the nodes it removes are put on 'limbo' for
+     * that epoch, linked with 'retired'. The epoch only moves on once
+     * nobody is left in the one before it, and the nodes removed in the
+     * epoch before that are freed then, since nobody can still be reading
+     * them. 'reclaiming' is set while a thread does so. */
+    size_t epoch;
+    size_t readers[DS_SKIPLIST_EPOCHS];
+    struct DSSkipNode *limbo[DS_SKIPLIST_EPOCHS];
+    bool reclaiming;
+};
+
+struct DSSkipNode {
+    void *data;
+    size_t level;
+    struct DSSkipNode *retired;
+
+    /* The next node in each of the node's 'level' levels. next[0] is the
+     * next node in the list. (This is allocated to 'level' entries.) */
+    struct DSSkipNode *next[1];
+};
+
+/**
+ * Creates an empty skip list ordered by 'compare'.
+ * 'ds_skiplist_free' should be called when done with the list.
+ */
+struct DSSkipList *
+ds_skiplist_create(int32_t (*compare)(void*, void*));
+
+/**
+ * Creates an empty skip list ordered by 'compare' that any number of
+ * threads may insert into, remove from and search at the same time.
+ * It is lock-free: a thread stalled in the middle of an operation never
+ * blocks the others.
+ *
+ * Nodes are marked as removed before being unlinked, and a thread that
+ * comes across a marked node helps unlink it. Since other threads may
+ * still be reading it, a removed node is only freed once every thread
+ * that was reading the list when it was removed is done (see
+ * 'ds_skiplist_enter'). A thread stalled inside a read holds back the
+ * freeing of every node removed after it entered, but no operation.
+ *
+ * Other threads may also still be comparing a removed element, so the
+ * element is freed along with its node, with 'free_data', and is never
+ * handed back to be freed by the caller. If 'free_data' is NULL, the list
+ * doesn't own its elements, and the caller must make sure that they
+ * outlive it (as with integers stored as pointers).
+ *
+ * Iterating with 'ds_skiplist_next' (and so 'ds_skiplist_range' and
+ * 'ds_skiplist_map') sees every element that is in the list for the whole
+ * scan, and may or may not see elements inserted or removed during it.
+ *
+ * 'ds_skiplist_free' must only be called once no other thread uses the
+ * list.
+ */
+struct DSSkipList *
+ds_skiplist_create_concurrent(int32_t (*compare)(void*, void*),
+                              void (*free_data)(void*));
+
+/**
+ * Frees all memory associated with the list and its elements.
+ * (The elements still waiting to be freed after being removed from a
+ * concurrent list are freed with its 'free_data' either way.)
+ */
+void
+ds_skiplist_free(struct DSSkipList *sl);
+
+/**
+ * Frees all memory associated with just the list.
+ * Does not free data memory.
+ */
+void
+ds_skiplist_free_no_data(struct DSSkipList *sl);
+
+/**
+ * Inserts 'data' into the list, after any elements equal to it.
+ * Runs in O(log n) expected time.
+ */
+void
+ds_skiplist_insert(struct DSSkipList *sl, void *data);
+
+/**
+ * Returns the first element such that compare(key, element) == 0, or NULL
+ * if there is none.
+ * Runs in O(log n) expected time.
+ */
+void *
+ds_skiplist_find(struct DSSkipList *sl, void *key);
+
+/**
+ * Removes the first element such that compare(key, element) == 0 and
+ * returns it, or returns NULL if there is none. The element's memory is
+ * NOT freed.
+ * Runs in O(log n) expected time.
+ *
+ * In a concurrent list, the element still belongs to the list, which
+ * frees it with its 'free_data' once no other thread can be reading it.
+ * So the caller must not free it, and may only use it until its own
+ * 'ds_skiplist_leave' if it removed it between 'ds_skiplist_enter' and
+ * 'ds_skiplist_leave'.
+ */
+void *
+ds_skiplist_remove(struct DSSkipList *sl, void *key);
+
+/**
+ * Starts a read of a concurrent list by the calling thread, and returns a
+ * guard to pass to 'ds_skiplist_leave' when the read is over. No node or
+ * element removed in between is freed before then.
+ *
+ * The other functions do this themselves, but the nodes returned by
+ * 'ds_skiplist_first', 'ds_skiplist_lower_bound' and 'ds_skiplist_next',
+ * and the element returned by 'ds_skiplist_find', may only be used
+ * between the two calls if other threads remove elements. Reads may nest,
+ * and should be kept short. For a list that isn't concurrent, these do
+ * nothing.
+ */
+size_t
+ds_skiplist_enter(struct DSSkipList *sl);
+
+/**
+ * Ends a read started by 'ds_skiplist_enter', which returned 'guard'.
+ */
+void
+ds_skiplist_leave(struct DSSkipList *sl, size_t guard);
+
+/**
+ * Returns the node of the first element in the list, or NULL if the list
+ * is empty.
+ */
+struct DSSkipNode *
+ds_skiplist_first(struct DSSkipList *sl);
+
+/**
+ * Returns the node of the first element for which compare(key, element)
+ * <= 0, or NULL if 'key' is greater than every element.
+ * Runs in O(log n) expected time.
+ */
+struct DSSkipNode *
+ds_skiplist_lower_bound(struct DSSkipList *sl, void *key);
+
+/**
+ * Returns the node after 'node' in the list, or NULL if 'node' is last.
+ * With 'ds_skiplist_lower_bound', this scans a range in order:
+ *
+ *  for (node = ds_skiplist_lower_bound(sl, low);
+ *       node != NULL && sl->compare(node->data, high) < 0;
+ *       node = ds_skiplist_next(sl, node))
+ *      use(node->data);
+ */
+struct DSSkipNode *
+ds_skiplist_next(struct DSSkipList *sl, struct DSSkipNode *node);
+
+/**
+ * Maps a function across every element from 'low' to 'high' inclusive,
+ * in order.
+ */
+void
+ds_skiplist_range(struct DSSkipList *sl, void *low, void *high,
+                  void (func)(void*));
+
+/**
+ * Convenience function to map a funcion across all elements in the list,
+ * in order.
+ */
+void
+ds_skiplist_map(struct DSSkipList *sl, void (func)(void*));
+
+#endif
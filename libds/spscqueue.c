@@ -0,0 +1,277 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "spscqueue.h"
+
+/* The size of a cache line. The producer's and consumer's fields are
+ * kept on lines of their own. */
+#define DS_SPSC_QUEUE_CACHE_LINE 64
+
+struct DSSpscQueue {
+    /* An array of elements in the queue. Item i is at buf[i & mask]. */
+    void **buf;
+    size_t mask;
+
+    char pad0[DS_SPSC_QUEUE_CACHE_LINE];
+
+    /* Written by the producer only: the index of the next item to put, and
+     * the consumer's `head` as the producer last saw it. */
+    size_t tail;
+    size_t head_cache;
+    char pad1[DS_SPSC_QUEUE_CACHE_LINE - 2 * sizeof(size_t)];
+
+    /* Written by the consumer only: the index of the next item to get, and
+     * the producer's `tail` as the consumer last saw it. */
+    size_t head;
+    size_t tail_cache;
+    char pad2[DS_SPSC_QUEUE_CACHE_LINE - 2 * sizeof(size_t)];
+
+    /* When true, the queue has been closed. */
+    bool closed;
+
+    /* True while the producer (consumer) is blocked, or about to block,
+     * on a full (empty) queue. Cleared by whoever wakes it. */
+    bool producer_waiting;
+    bool consumer_waiting;
+
+    /* Guards blocking on `cond`. */
+    pthread_mutex_t mutate;
+
+    /* Pinged to wake a waiting producer or consumer, or when the queue has
+     * been closed. */
+    pthread_cond_t cond;
+};
+
+/* private helper functions */
+static bool
+ds_spsc_queue_try_put(struct DSSpscQueue *queue, void *item);
+
+static bool
+ds_spsc_queue_try_get(struct DSSpscQueue *queue, void **item);
+
+static void
+ds_spsc_queue_wake(struct DSSpscQueue *queue, bool *waiting);
+
+struct DSSpscQueue *
+ds_spsc_queue_create(size_t capacity)
+{
+    struct DSSpscQueue *queue;
+    size_t size;
+    int errno;
+
+    assert(capacity > 0);
+
+    for (size = 1; size < capacity; size *= 2)
+        ;
+
+    queue = malloc(sizeof(*queue));
+    assert(queue);
+
+    queue->buf = malloc(size * sizeof(*queue->buf));
+    assert(queue->buf);
+
+    queue->mask = size - 1;
+    queue->tail = 0;
+    queue->head_cache = 0;
+    queue->head = 0;
+    queue->tail_cache = 0;
+    queue->closed = false;
+    queue->producer_waiting = false;
+    queue->consumer_waiting = false;
+
+    if (0 != (errno = pthread_mutex_init(&queue->mutate, NULL))) {
+        fprintf(stderr, "Could not create mutex. Errno: %d\n", errno);
+        exit(1);
+    }
+    if (0 != (errno = pthread_cond_init(&queue->cond, NULL))) {
+        fprintf(stderr, "Could not create cond var. Errno: %d\n", errno);
+        exit(1);
+    }
+
+    return queue;
+}
+
+void
+ds_spsc_queue_free(struct DSSpscQueue *queue)
+{
+    int errno;
+
+    if (0 != (errno = pthread_mutex_destroy(&queue->mutate))) {
+        fprintf(stderr, "Could not destroy mutex. Errno: %d\n", errno);
+        exit(1);
+    }
+    if (0 != (errno = pthread_cond_destroy(&queue->cond))) {
+        fprintf(stderr, "Could not destroy cond var. Errno: %d\n", errno);
+        exit(1);
+    }
+    free(queue->buf);
+    free(queue);
+}
+
+size_t
+ds_spsc_queue_length(struct DSSpscQueue *queue)
+{
+    size_t head, tail;
+
+    head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+    return tail - head;
+}
+
+size_t
+ds_spsc_queue_capacity(struct DSSpscQueue *queue)
+{
+    return queue->mask + 1;
+}
+
+void
+ds_spsc_queue_close(struct DSSpscQueue *queue)
+{
+    pthread_mutex_lock(&queue->mutate);
+    __atomic_store_n(&queue->closed, true, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&queue->consumer_waiting, false, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutate);
+}
+
+int
+ds_spsc_queue_put(struct DSSpscQueue *queue, void *item)
+{
+    /* Only the producer closes the queue, so this can't race. */
+    if (__atomic_load_n(&queue->closed, __ATOMIC_RELAXED))
+        return DS_QUEUE_CLOSED;
+
+    if (!ds_spsc_queue_try_put(queue, item)) {
+        /* Announce the wait before the last try, so that a get that
+         * doesn't see the announcement has made room the try will see. */
+        pthread_mutex_lock(&queue->mutate);
+        for (;;) {
+            __atomic_store_n(&queue->producer_waiting, true, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+            if (ds_spsc_queue_try_put(queue, item)) {
+                __atomic_store_n(&queue->producer_waiting, false,
+                                 __ATOMIC_RELAXED);
+                break;
+            }
+
+            while (__atomic_load_n(&queue->producer_waiting,
+                                   __ATOMIC_RELAXED))
+                pthread_cond_wait(&queue->cond, &queue->mutate);
+        }
+        pthread_mutex_unlock(&queue->mutate);
+    }
+
+    ds_spsc_queue_wake(queue, &queue->consumer_waiting);
+
+    return DS_QUEUE_OK;
+}
+
+void *
+ds_spsc_queue_get(struct DSSpscQueue *queue)
+{
+    void *item;
+    bool got;
+
+    if (!ds_spsc_queue_try_get(queue, &item)) {
+        got = false;
+        pthread_mutex_lock(&queue->mutate);
+        for (;;) {
+            __atomic_store_n(&queue->consumer_waiting, true, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+            if (ds_spsc_queue_try_get(queue, &item)) {
+                __atomic_store_n(&queue->consumer_waiting, false,
+                                 __ATOMIC_RELAXED);
+                got = true;
+                break;
+            }
+
+            /* The producer puts everything before closing, so after the
+             * close, one last try sees all of it. */
+            if (__atomic_load_n(&queue->closed, __ATOMIC_SEQ_CST)) {
+                __atomic_store_n(&queue->consumer_waiting, false,
+                                 __ATOMIC_RELAXED);
+                got = ds_spsc_queue_try_get(queue, &item);
+                break;
+            }
+
+            while (__atomic_load_n(&queue->consumer_waiting,
+                                   __ATOMIC_RELAXED))
+                pthread_cond_wait(&queue->cond, &queue->mutate);
+        }
+        pthread_mutex_unlock(&queue->mutate);
+
+        /* Whatever the item is, even NULL, getting it freed a slot that a
+         * blocked producer has to hear about. */
+        if (!got)
+            return NULL;
+    }
+
+    ds_spsc_queue_wake(queue, &queue->producer_waiting);
+
+    return item;
+}
+
+/* Puts an item if there is room. The consumer's index is only read when
+ * the cached copy of it says the queue is full. The release store of
+ * `tail` publishes the item to the consumer. */
+static bool
+ds_spsc_queue_try_put(struct DSSpscQueue *queue, void *item)
+{
+    size_t tail;
+
+    tail = queue->tail;
+    if (tail - queue->head_cache > queue->mask) {
+        queue->head_cache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if (tail - queue->head_cache > queue->mask)
+            return false;
+    }
+
+    queue->buf[tail & queue->mask] = item;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/* Gets an item if there is one. The mirror image of try_put. */
+static bool
+ds_spsc_queue_try_get(struct DSSpscQueue *queue, void **item)
+{
+    size_t head;
+
+    head = queue->head;
+    if (head == queue->tail_cache) {
+        queue->tail_cache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if (head == queue->tail_cache)
+            return false;
+    }
+
+    *item = queue->buf[head & queue->mask];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/* Wakes the other side if it is waiting. The fence orders the put (get)
+ * that was just made before the read of the flag, pairing with the fence
+ * the waiter has between setting the flag and its last try. It is paid on
+ * every call: reading the flag first, without it, could see a stale false
+ * while the waiter's last try sees a stale index, and it would sleep with
+ * nobody to wake it. */
+static void
+ds_spsc_queue_wake(struct DSSpscQueue *queue, bool *waiting)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(waiting, __ATOMIC_RELAXED))
+        return;
+
+    pthread_mutex_lock(&queue->mutate);
+    __atomic_store_n(waiting, false, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutate);
+}
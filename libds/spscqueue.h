@@ -0,0 +1,67 @@
+#ifndef __LIBDS_SPSCQUEUE_H__
+#define __LIBDS_SPSCQUEUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "queue.h"
+
+/*
+ * DSSpscQueue is a thread-safe queue for exactly one producer thread and
+ * one consumer thread. Only one thread may call ds_spsc_queue_put (and
+ * ds_spsc_queue_close), and only one thread may call ds_spsc_queue_get.
+ * Otherwise putting, getting and closing behave like ds_queue_put,
+ * ds_queue_get and ds_queue_close, and return the same DS_QUEUE_* codes.
+ *
+ * In exchange, putting and getting need no locks and no atomic
+ * read-modify-write instructions: each side only writes its own index,
+ * and reads the other side's index only when its cached copy says the
+ * queue is full (or empty). The two indexes live on separate cache lines,
+ * so while the queue is neither full nor empty, the two threads rarely
+ * touch the same line.
+ * A side that has to wait blocks on a condition variable, and is woken
+ * by the other side only if it is actually waiting. To see whether it is,
+ * every put and get pays for one full memory fence (an `mfence` on x86),
+ * even when nobody is waiting; without it, a side could miss that the
+ * other has just gone to sleep.
+ */
+struct DSSpscQueue;
+
+/* Allocates a new DSSpscQueue that can hold at least 'capacity' items.
+ * The capacity is rounded up to a power of two. */
+struct DSSpscQueue *
+ds_spsc_queue_create(size_t capacity);
+
+/* Frees all data used to create a DSSpscQueue. Neither thread may be using
+ * it anymore. Note that the data inside the buffer is not freed. */
+void
+ds_spsc_queue_free(struct DSSpscQueue *queue);
+
+/* Returns the current length (number of items) in the queue. */
+size_t
+ds_spsc_queue_length(struct DSSpscQueue *queue);
+
+/* Returns the capacity of the queue (a power of two). */
+size_t
+ds_spsc_queue_capacity(struct DSSpscQueue *queue);
+
+/* Closes a queue, as with ds_queue_close. Only the producer may close the
+ * queue. Once the consumer has gotten the items left in it,
+ * `ds_spsc_queue_get` returns NULL without blocking. */
+void
+ds_spsc_queue_close(struct DSSpscQueue *queue);
+
+/* Adds a new value to the queue, blocking while it is full, and returns
+ * DS_QUEUE_OK. If the queue has been closed, nothing is added and
+ * DS_QUEUE_CLOSED is returned. */
+int
+ds_spsc_queue_put(struct DSSpscQueue *queue, void *item);
+
+/* Reads the next value from the queue, blocking while it is empty.
+ * If the queue is closed and empty, NULL is returned immediately. As with
+ * ds_queue_get, a NULL value put in the queue can't be told apart from
+ * that. */
+void *
+ds_spsc_queue_get(struct DSSpscQueue *queue);
+
+#endif
@@ -0,0 +1,435 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "unrolledlist.h"
+#include "vector.h"
+
+/* private helper functions */
+static struct DSUListNode *
+ds_ulist_node_create(struct DSUnrolledList *lst, struct DSUListNode *after);
+
+static void
+ds_ulist_node_free(struct DSUnrolledList *lst, struct DSUListNode *node);
+
+static void
+ds_ulist_free_nodes(struct DSUnrolledList *lst, bool free_data);
+
+static void
+ds_ulist_insert_at(struct DSUnrolledList *lst, struct DSUListNode *node,
+                   size_t index, void *data, struct DSUListIter *iter);
+
+static void
+ds_ulist_remove_at(struct DSUnrolledList *lst, struct DSUListNode *node,
+                   size_t index, struct DSUListIter *iter);
+
+static void
+ds_ulist_moved(struct DSUListIter *iter, struct DSUListNode *from,
+               size_t start, struct DSUListNode *to, size_t dest);
+
+static void
+ds_ulist_merge_sort(void **data, size_t size,
+                    int32_t (compare)(void*, void*));
+
+static void
+ds_ulist_merge(void **a, size_t alen, void **b, size_t blen, void **out,
+               int32_t (compare)(void*, void*));
+
+/* Runs of this many elements are insertion sorted before merging. */
+#define DS_ULIST_SORT_RUN 16
+
+struct DSUnrolledList *
+ds_ulist_create()
+{
+    struct DSUnrolledList *lst;
+
+    lst = malloc(sizeof(*lst));
+    assert(lst);
+
+    lst->length = 0;
+    lst->first = NULL;
+    lst->last = NULL;
+
+    return lst;
+}
+
+void
+ds_ulist_free(struct DSUnrolledList *lst)
+{
+    ds_ulist_free_nodes(lst, true);
+}
+
+void
+ds_ulist_free_no_data(struct DSUnrolledList *lst)
+{
+    ds_ulist_free_nodes(lst, false);
+}
+
+static void
+ds_ulist_free_nodes(struct DSUnrolledList *lst, bool free_data)
+{
+    struct DSUListNode *node, *temp;
+    size_t i;
+
+    node = lst->first;
+    while (node != NULL) {
+        temp = node->next;
+        if (free_data)
+            for (i = 0; i < node->count; ++i)
+                free(node->data[i]);
+        free(node);
+        node = temp;
+    }
+
+    free(lst);
+}
+
+void
+ds_ulist_prepend(struct DSUnrolledList *lst, void *data)
+{
+    ds_ulist_insert_at(lst, lst->first, 0, data, NULL);
+}
+
+void
+ds_ulist_append(struct DSUnrolledList *lst, void *data)
+{
+    struct DSUListNode *node;
+
+    node = lst->last;
+    if (node == NULL || node->count == DS_ULIST_NODE_CAPACITY)
+        node = ds_ulist_node_create(lst, lst->last);
+
+    node->data[node->count++] = data;
+    ++lst->length;
+}
+
+struct DSUnrolledList *
+ds_ulist_copy(struct DSUnrolledList *lst)
+{
+    struct DSUnrolledList *copy;
+    struct DSUListNode *node;
+    size_t i;
+
+    copy = ds_ulist_create();
+
+    for (node = lst->first; node; node = node->next)
+        for (i = 0; i < node->count; ++i)
+            ds_ulist_append(copy, node->data[i]);
+
+    return copy;
+}
+
+void
+ds_ulist_iter_insert(struct DSUnrolledList *lst, struct DSUListIter *iter,
+                     void *data)
+{
+    if (iter->current == NULL)
+        ds_ulist_insert_at(lst, lst->first, 0, data, iter);
+    else
+        ds_ulist_insert_at(lst, iter->current, iter->current_index + 1,
+                           data, iter);
+}
+
+void
+ds_ulist_iter_remove(struct DSUnrolledList *lst, struct DSUListIter *iter)
+{
+    struct DSUListNode *node;
+
+    assert(iter->current != NULL);
+
+    node = iter->current;
+    iter->current = NULL;
+    ds_ulist_remove_at(lst, node, iter->current_index, iter);
+}
+
+void
+ds_ulist_iter_destroy(struct DSUnrolledList *lst, struct DSUListIter *iter)
+{
+    assert(iter->current != NULL);
+
+    free(iter->current->data[iter->current_index]);
+    ds_ulist_iter_remove(lst, iter);
+}
+
+void
+ds_ulist_map(struct DSUnrolledList *lst, void (func)(void*))
+{
+    struct DSUListNode *node;
+    size_t i;
+
+    for (node = lst->first; node; node = node->next)
+        for (i = 0; i < node->count; ++i)
+            func(node->data[i]);
+}
+
+void
+ds_ulist_sort(struct DSUnrolledList *lst, int32_t (compare)(void*, void*))
+{
+    struct DSVector vec;
+    struct DSUListNode *node, *temp;
+    size_t i, j;
+
+    if (lst->length < 2)
+        return;
+
+    ds_vector_init_capacity(&vec, lst->length);
+    for (node = lst->first; node; node = node->next)
+        for (i = 0; i < node->count; ++i)
+            ds_vector_append(&vec, node->data[i]);
+
+    ds_ulist_merge_sort(vec.data, vec.size, compare);
+
+    /* Write the elements back, filling each node before moving on to the
+     * next one. Since no node held more than a full node's worth, the
+     * existing nodes are enough, and any left over at the end are freed. */
+    node = lst->first;
+    for (i = 0; i < vec.size; i += node->count, node = node->next) {
+        node->count = vec.size - i;
+        if (node->count > DS_ULIST_NODE_CAPACITY)
+            node->count = DS_ULIST_NODE_CAPACITY;
+        for (j = 0; j < node->count; ++j)
+            node->data[j] = vec.data[i + j];
+    }
+
+    while (node != NULL) {
+        temp = node->next;
+        ds_ulist_node_free(lst, node);
+        node = temp;
+    }
+
+    ds_vector_release(&vec);
+}
+
+/* A bottom-up merge sort. Short runs are insertion sorted in place, then
+ * merged pairwise back and forth between 'data' and a scratch buffer, with
+ * ties taken from the earlier run, so equal elements keep their order. */
+static void
+ds_ulist_merge_sort(void **data, size_t size,
+                    int32_t (compare)(void*, void*))
+{
+    void **src, **dst, **temp, *val;
+    size_t start, width, mid, end, i, j;
+
+    for (start = 0; start < size; start += DS_ULIST_SORT_RUN) {
+        end = start + DS_ULIST_SORT_RUN < size ? start + DS_ULIST_SORT_RUN
+                                               : size;
+        for (i = start + 1; i < end; ++i) {
+            val = data[i];
+            for (j = i; j > start && compare(val, data[j - 1]) < 0; --j)
+                data[j] = data[j - 1];
+            data[j] = val;
+        }
+    }
+
+    if (size <= DS_ULIST_SORT_RUN)
+        return;
+
+    dst = malloc(size * sizeof(*dst));
+    assert(dst);
+    src = data;
+
+    for (width = DS_ULIST_SORT_RUN; width < size; width *= 2) {
+        for (start = 0; start < size; start += 2 * width) {
+            mid = start + width < size ? start + width : size;
+            end = mid + width < size ? mid + width : size;
+            ds_ulist_merge(src + start, mid - start, src + mid, end - mid,
+                           dst + start, compare);
+        }
+        temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    /* 'src' holds the sorted elements, and 'dst' the other buffer */
+    if (src != data) {
+        memcpy(data, src, size * sizeof(*data));
+        free(src);
+    } else {
+        free(dst);
+    }
+}
+
+/* Merges a[0..alen) and b[0..blen) into out. Ties go to 'a'. */
+static void
+ds_ulist_merge(void **a, size_t alen, void **b, size_t blen, void **out,
+               int32_t (compare)(void*, void*))
+{
+    size_t i, j, k;
+
+    i = j = k = 0;
+    while (i < alen && j < blen) {
+        if (compare(b[j], a[i]) < 0)
+            out[k++] = b[j++];
+        else
+            out[k++] = a[i++];
+    }
+    while (i < alen)
+        out[k++] = a[i++];
+    while (j < blen)
+        out[k++] = b[j++];
+}
+
+/* Allocates an empty node and links it into the list after 'after', or at
+ * the beginning of the list if 'after' is NULL. */
+static struct DSUListNode *
+ds_ulist_node_create(struct DSUnrolledList *lst, struct DSUListNode *after)
+{
+    struct DSUListNode *node;
+
+    node = malloc(sizeof(*node));
+    assert(node);
+
+    node->count = 0;
+    node->prev = after;
+    node->next = after != NULL ? after->next : lst->first;
+
+    if (node->prev != NULL)
+        node->prev->next = node;
+    else
+        lst->first = node;
+
+    if (node->next != NULL)
+        node->next->prev = node;
+    else
+        lst->last = node;
+
+    return node;
+}
+
+/* Unlinks a node from the list and frees it (but not its elements). */
+static void
+ds_ulist_node_free(struct DSUnrolledList *lst, struct DSUListNode *node)
+{
+    if (node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        lst->first = node->next;
+
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    else
+        lst->last = node->prev;
+
+    free(node);
+}
+
+/* Inserts 'data' at position 'index' of 'node' (index may be node->count,
+ * i.e. the end of the node). 'node' may only be NULL when the list is
+ * empty. If 'iter' isn't NULL, its positions are kept on the same elements.
+ *
+ * When the node is full, an element going at either end of it goes into
+ * the neighbouring node instead, if there is room, or into a new node.
+ * Otherwise the node is split in two halves. Either way, only the elements
+ * of one node are moved. */
+static void
+ds_ulist_insert_at(struct DSUnrolledList *lst, struct DSUListNode *node,
+                   size_t index, void *data, struct DSUListIter *iter)
+{
+    struct DSUListNode *split;
+    size_t half;
+
+    if (node == NULL) {
+        node = ds_ulist_node_create(lst, NULL);
+    } else if (node->count == DS_ULIST_NODE_CAPACITY) {
+        if (index == 0) {
+            if (node->prev == NULL
+                || node->prev->count == DS_ULIST_NODE_CAPACITY)
+                ds_ulist_node_create(lst, node->prev);
+            node = node->prev;
+            index = node->count;
+        } else if (index == DS_ULIST_NODE_CAPACITY) {
+            if (node->next == NULL
+                || node->next->count == DS_ULIST_NODE_CAPACITY)
+                ds_ulist_node_create(lst, node);
+            node = node->next;
+            index = 0;
+        } else {
+            half = DS_ULIST_NODE_CAPACITY / 2;
+            split = ds_ulist_node_create(lst, node);
+            memcpy(split->data, node->data + half,
+                   (DS_ULIST_NODE_CAPACITY - half) * sizeof(void*));
+            split->count = DS_ULIST_NODE_CAPACITY - half;
+            node->count = half;
+            ds_ulist_moved(iter, node, half, split, 0);
+
+            if (index > half) {
+                node = split;
+                index -= half;
+            }
+        }
+    }
+
+    memmove(node->data + index + 1, node->data + index,
+            (node->count - index) * sizeof(void*));
+    ds_ulist_moved(iter, node, index, node, index + 1);
+
+    node->data[index] = data;
+    ++node->count;
+    ++lst->length;
+}
+
+/* Removes the element at position 'index' of 'node'. If 'iter' isn't NULL,
+ * its positions are kept on the same elements (neither of them may be on
+ * the removed element).
+ *
+ * A node left empty is freed. One left less than a quarter full is merged
+ * into its next or previous node, if either has room for its elements. */
+static void
+ds_ulist_remove_at(struct DSUnrolledList *lst, struct DSUListNode *node,
+                   size_t index, struct DSUListIter *iter)
+{
+    struct DSUListNode *other;
+
+    memmove(node->data + index, node->data + index + 1,
+            (node->count - index - 1) * sizeof(void*));
+    ds_ulist_moved(iter, node, index + 1, node, index);
+
+    --node->count;
+    --lst->length;
+
+    if (node->count == 0) {
+        ds_ulist_node_free(lst, node);
+        return;
+    }
+
+    if (node->count >= DS_ULIST_NODE_CAPACITY / 4)
+        return;
+
+    other = node->next;
+    if (other != NULL && node->count + other->count <= DS_ULIST_NODE_CAPACITY) {
+        memcpy(node->data + node->count, other->data,
+               other->count * sizeof(void*));
+        ds_ulist_moved(iter, other, 0, node, node->count);
+        node->count += other->count;
+        ds_ulist_node_free(lst, other);
+        return;
+    }
+
+    other = node->prev;
+    if (other != NULL && node->count + other->count <= DS_ULIST_NODE_CAPACITY) {
+        memcpy(other->data + other->count, node->data,
+               node->count * sizeof(void*));
+        ds_ulist_moved(iter, node, 0, other, other->count);
+        other->count += node->count;
+        ds_ulist_node_free(lst, node);
+    }
+}
+
+/* Tells the iterator (if any) that the elements of 'from' at positions
+ * 'start' and up have moved to 'to', starting at position 'dest'. */
+static void
+ds_ulist_moved(struct DSUListIter *iter, struct DSUListNode *from,
+               size_t start, struct DSUListNode *to, size_t dest)
+{
+    if (iter == NULL)
+        return;
+
+    if (iter->current == from && iter->current_index >= start) {
+        iter->current = to;
+        iter->current_index = iter->current_index - start + dest;
+    }
+
+    if (iter->next == from && iter->next_index >= start) {
+        iter->next = to;
+        iter->next_index = iter->next_index - start + dest;
+    }
+}
@@ -0,0 +1,208 @@
+#ifndef __LIBDS_UNROLLEDLIST_H__
+#define __LIBDS_UNROLLEDLIST_H__
+
+/* #define NDEBUG */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The number of elements held by each node. (A #define, since it sizes
+ * the array in DSUListNode.) */
+#define DS_ULIST_NODE_CAPACITY 32
+
+/**
+ * A DSUnrolledList is a doubly linked list whose nodes each hold up to
+ * DS_ULIST_NODE_CAPACITY elements in an array, instead of just one.
+ * Walking the list touches one node per run of elements, so scans and
+ * maps run at close to the speed of an array, while inserting and
+ * removing in the middle of the list still only moves the elements of a
+ * single node.
+ *
+ * A full node is split in two when an element is inserted in its middle,
+ * and a node left less than a quarter full by a removal is merged into a
+ * neighbour that has room for its elements.
+ */
+struct DSUnrolledList {
+    size_t length;
+    struct DSUListNode *first;
+    struct DSUListNode *last;
+};
+
+struct DSUListNode {
+    /* The number of elements in 'data'. Never 0 for a node in a list. */
+    size_t count;
+    struct DSUListNode *prev;
+    struct DSUListNode *next;
+    void *data[DS_ULIST_NODE_CAPACITY];
+};
+
+/**
+ * A DSUListIter walks a list forward or backward, in the manner of
+ * DSListIter. Elements can be inserted after, or removed at, the element
+ * most recently returned by 'ds_ulist_iter_next' without breaking the
+ * iteration.
+ *
+ *  struct DSUListIter iter;
+ *  void **item;
+ *
+ *  ds_ulist_iter_begin(lst, &iter, false);
+ *  while (NULL != (item = ds_ulist_iter_next(&iter)))
+ *      if (should_drop(*item))
+ *          ds_ulist_iter_remove(lst, &iter);
+ */
+struct DSUListIter {
+    /* The element most recently returned by ds_ulist_iter_next
+     * ('current' is NULL if there is none). */
+    struct DSUListNode *current;
+    size_t current_index;
+
+    /* The element that ds_ulist_iter_next will return ('next' is NULL at
+     * the end of the list). */
+    struct DSUListNode *next;
+    size_t next_index;
+
+    bool reverse;
+};
+
+/**
+ * Initializes memory for a DSUnrolledList.
+ * 'ds_ulist_free' should be called when done with the list.
+ */
+struct DSUnrolledList *
+ds_ulist_create();
+
+/**
+ * Frees all memory associated with the list and its elements.
+ */
+void
+ds_ulist_free(struct DSUnrolledList *lst);
+
+/**
+ * Frees all memory associated with just the list.
+ * Does not free data memory.
+ */
+void
+ds_ulist_free_no_data(struct DSUnrolledList *lst);
+
+/**
+ * Prepends 'data' to the beginning of the list.
+ * Runs in constant time.
+ */
+void
+ds_ulist_prepend(struct DSUnrolledList *lst, void *data);
+
+/**
+ * Appends 'data' to the end of the list.
+ * Runs in constant time.
+ */
+void
+ds_ulist_append(struct DSUnrolledList *lst, void *data);
+
+/**
+ * Copies a list's structure, packing the copy's nodes full.
+ * Data is not copied.
+ */
+struct DSUnrolledList *
+ds_ulist_copy(struct DSUnrolledList *lst);
+
+/**
+ * Starts iterating over a list, from the first element, or from the last
+ * element when 'reverse' is true.
+ * (Defined here so that iterating compiles down to a plain loop.)
+ */
+static __inline__ void
+ds_ulist_iter_begin(struct DSUnrolledList *lst, struct DSUListIter *iter,
+                    bool reverse)
+{
+    iter->current = NULL;
+    iter->current_index = 0;
+    iter->next = reverse ? lst->last : lst->first;
+    iter->next_index = 0;
+    if (reverse && iter->next != NULL)
+        iter->next_index = iter->next->count - 1;
+    iter->reverse = reverse;
+}
+
+/**
+ * Returns a pointer to the next element of the iteration, or NULL when
+ * there is none. The element may be replaced by assigning through the
+ * pointer.
+ */
+static __inline__ void **
+ds_ulist_iter_next(struct DSUListIter *iter)
+{
+    struct DSUListNode *node;
+    size_t index;
+
+    node = iter->next;
+    index = iter->next_index;
+
+    iter->current = node;
+    iter->current_index = index;
+    if (node == NULL)
+        return NULL;
+
+    if (!iter->reverse) {
+        if (index + 1 < node->count) {
+            iter->next_index = index + 1;
+        } else {
+            iter->next = node->next;
+            iter->next_index = 0;
+        }
+    } else {
+        if (index > 0) {
+            iter->next_index = index - 1;
+        } else {
+            iter->next = node->prev;
+            if (node->prev != NULL)
+                iter->next_index = node->prev->count - 1;
+        }
+    }
+
+    return &node->data[index];
+}
+
+/**
+ * Inserts 'data' right after the element most recently returned by
+ * 'ds_ulist_iter_next' (in list order, whatever the direction of the
+ * iteration), or at the beginning of the list if there is none.
+ * The new element is not visited by the iteration.
+ * Runs in amortized constant time.
+ */
+void
+ds_ulist_iter_insert(struct DSUnrolledList *lst, struct DSUListIter *iter,
+                     void *data);
+
+/**
+ * Removes the element most recently returned by 'ds_ulist_iter_next' from
+ * the list, but does NOT free the data's memory. Iteration continues with
+ * the element that followed it.
+ * Runs in amortized constant time.
+ */
+void
+ds_ulist_iter_remove(struct DSUnrolledList *lst, struct DSUListIter *iter);
+
+/**
+ * Like 'ds_ulist_iter_remove', but DOES free the data's memory.
+ */
+void
+ds_ulist_iter_destroy(struct DSUnrolledList *lst, struct DSUListIter *iter);
+
+/**
+ * Convenience function to map a funcion across all elements in the list.
+ */
+void
+ds_ulist_map(struct DSUnrolledList *lst, void (func)(void*));
+
+/**
+ * Sorts the list in place. The sort is stable: elements that compare
+ * equal keep their order. The elements are gathered into an array, merge
+ * sorted through a scratch array of the same size and written back, which
+ * also packs the nodes full.
+ */
+void
+ds_ulist_sort(struct DSUnrolledList *lst, int32_t (compare)(void*, void*));
+
+#endif
@@ -1,60 +1,277 @@
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "vector.h"
 
-/* private function to check and possibly expand a vector's capacity */
+/* x86-64 always has SSE2; AVX2 is picked at run time when available */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DS_VECTOR_SIMD
+#include <immintrin.h>
+#endif
+
+/* Runs shorter than this are insertion sorted by the quicksort. */
+#define DS_VECTOR_INSERTION_SORT 16
+
+/* Swaps d[i] and d[j] through 'temp'. */
+#define DS_VECTOR_SWAP(d, i, j, temp) \
+    do { (temp) = (d)[i]; (d)[i] = (d)[j]; (d)[j] = (temp); } while (0)
+
+/* Lets a plain comparison function be used by the context-carrying sorts. */
+struct DSVectorCompare {
+    int32_t (*compare)(void*, void*);
+};
+
+/* A key extracted by ds_vector_sort_by_key and the element it came from. */
+struct DSVectorKeyed {
+    uint64_t key;
+    void *data;
+};
+
+/* A batch of equally sized jobs handed out to worker threads. */
+struct DSVectorJobs {
+    char *jobs;
+    size_t job_size;
+    size_t count;
+
+    /* The index of the next job to hand out. Guarded by 'lock'. */
+    size_t next;
+
+    void (*work)(void *job);
+    pthread_mutex_t lock;
+};
+
+/* A run of the vector (inclusive bounds) to quicksort on one thread. */
+struct DSVectorSortJob {
+    struct DSVector *vec;
+    size_t left;
+    size_t right;
+    int32_t (*compare)(void*, void*);
+};
+
+/* A block of the vector, [start, end), for the parallel map and reduce.
+ * The reduce fills in 'result'. */
+struct DSVectorBlockJob {
+    void **data;
+    size_t start;
+    size_t end;
+    void *ctx;
+    void (*map)(void*, void*);
+    void *(*init)(void*);
+    void *(*reduce)(void*, void*, void*);
+    void *result;
+};
+
+/* A piece of a merge: a[0..alen) and b[0..blen) are merged into out. */
+struct DSVectorMergeJob {
+    void **a;
+    void **b;
+    void **out;
+    size_t alen;
+    size_t blen;
+    int32_t (*compare)(void*, void*);
+};
+
+/* private function to make room for 'count' more elements in a vector */
 static void
-ds_vector_maybe_expand(struct DSVector *vec);
+ds_vector_maybe_expand(struct DSVector *vec, size_t count);
 
 /* private helper functions for quicksort */
 static void
-ds_vector_quicksort(struct DSVector *vec, int32_t left, int32_t right,
-                    int32_t (compare)(void *, void*));
+ds_vector_quicksort(struct DSVector *vec, size_t left, size_t right,
+                    int32_t (compare)(void*, void*, void*), void *ctx);
+
+static void
+ds_vector_introsort(struct DSVector *vec, size_t left, size_t right,
+                    size_t depth,
+                    int32_t (compare)(void*, void*, void*), void *ctx);
+
+static size_t
+ds_vector_median(struct DSVector *vec, size_t left, size_t right,
+                 int32_t (compare)(void*, void*, void*), void *ctx);
+
+static void
+ds_vector_partition(struct DSVector *vec, size_t left, size_t right,
+                    size_t pivot, size_t *lt, size_t *gt,
+                    int32_t (compare)(void*, void*, void*), void *ctx);
+
+static void
+ds_vector_insertion_sort(struct DSVector *vec, size_t left, size_t right,
+                         int32_t (compare)(void*, void*, void*), void *ctx);
+
+static void
+ds_vector_heapsort(struct DSVector *vec, size_t left, size_t right,
+                   int32_t (compare)(void*, void*, void*), void *ctx);
+
+static void
+ds_vector_sift_down(void **heap, size_t root, size_t size,
+                    int32_t (compare)(void*, void*, void*), void *ctx);
+
+static int32_t
+ds_vector_compare_plain(void *a, void *b, void *ctx);
 
+/* private helpers for the pointer search */
+static size_t
+ds_vector_find_ptr_scalar(void **data, size_t size, size_t i, void *needle);
+
+#ifdef DS_VECTOR_SIMD
+static size_t
+ds_vector_find_ptr_sse2(void **data, size_t size, void *needle);
+
+static size_t
+ds_vector_find_ptr_avx2(void **data, size_t size, void *needle);
+#endif
+
+/* private helpers for the parallel sort */
 static int32_t
-ds_vector_partition(struct DSVector *vec, int32_t left, int32_t right,
-                    int32_t pivot,
-                    int32_t (compare)(void *, void*));
+ds_vector_threads(int32_t nthreads);
+
+static void
+ds_vector_parallel_run(void *jobs, size_t count, size_t job_size,
+                       void (work)(void*), int32_t nthreads);
+
+static void *
+ds_vector_parallel_worker(void *jobs);
+
+static void
+ds_vector_sort_job(void *job);
+
+static void
+ds_vector_merge_job(void *job);
+
+/* private helpers for the parallel map and reduce */
+static struct DSVectorBlockJob *
+ds_vector_blocks(struct DSVector *vec, size_t *count, void *ctx);
+
+static void
+ds_vector_map_job(void *job);
+
+static void
+ds_vector_reduce_job(void *job);
+
+static size_t
+ds_vector_merge_split(void **a, size_t alen, void **b, size_t blen,
+                      size_t diag, int32_t (compare)(void*, void*));
 
 struct DSVector *
 ds_vector_create()
 {
-    return ds_vector_create_capacity(DS_VECTOR_BASE_CAPACITY);
+    return ds_vector_create_capacity(DS_VECTOR_INLINE_CAPACITY);
 }
 
 struct DSVector *
-ds_vector_create_capacity(int32_t capacity)
+ds_vector_create_capacity(size_t capacity)
 {
     struct DSVector *vec;
 
     vec = malloc(sizeof(*vec));
     assert(vec);
 
+    ds_vector_init_capacity(vec, capacity);
+
+    return vec;
+}
+
+void
+ds_vector_init(struct DSVector *vec)
+{
+    ds_vector_init_capacity(vec, DS_VECTOR_INLINE_CAPACITY);
+}
+
+void
+ds_vector_init_capacity(struct DSVector *vec, size_t capacity)
+{
+    vec->size = 0;
+    vec->capacity = DS_VECTOR_INLINE_CAPACITY;
+    vec->data = vec->inline_data;
+    ds_vector_reserve(vec, capacity);
+
+    vec->expand_ratio = DS_VECTOR_EXPAND_RATIO;
+    vec->expand_step = 0;
+}
+
+void
+ds_vector_release(struct DSVector *vec)
+{
+    if (vec->data != vec->inline_data)
+        free(vec->data);
+
     vec->size = 0;
+    vec->capacity = DS_VECTOR_INLINE_CAPACITY;
+    vec->data = vec->inline_data;
+}
+
+void
+ds_vector_set_growth(struct DSVector *vec, float ratio, size_t step)
+{
+    assert(ratio > 1.0);
+
+    vec->expand_ratio = ratio;
+    vec->expand_step = step;
+}
+
+void
+ds_vector_reserve(struct DSVector *vec, size_t capacity)
+{
+    if (capacity <= vec->capacity)
+        return;
+
+    if (capacity > SIZE_MAX / sizeof(*vec->data)) {
+        fprintf(stderr, "Vector capacity overflow: %lu elements.\n",
+                (unsigned long) capacity);
+        exit(1);
+    }
+
+    /* spilling out of the inline storage */
+    if (vec->data == vec->inline_data) {
+        vec->data = malloc(capacity * sizeof(*vec->data));
+        assert(vec->data);
+        memcpy(vec->data, vec->inline_data, vec->size * sizeof(*vec->data));
+    } else {
+        vec->data = realloc(vec->data, capacity * sizeof(*vec->data));
+        assert(vec->data);
+    }
+
     vec->capacity = capacity;
-    vec->data = malloc(vec->capacity * sizeof(*vec->data));
-    assert(vec->data);
+}
 
-    return vec;
+void
+ds_vector_shrink_to_fit(struct DSVector *vec)
+{
+    if (vec->data == vec->inline_data || vec->capacity == vec->size)
+        return;
+
+    if (vec->size <= DS_VECTOR_INLINE_CAPACITY) {
+        memcpy(vec->inline_data, vec->data, vec->size * sizeof(*vec->data));
+        free(vec->data);
+
+        vec->data = vec->inline_data;
+        vec->capacity = DS_VECTOR_INLINE_CAPACITY;
+        return;
+    }
+
+    vec->capacity = vec->size;
+    vec->data = realloc(vec->data, vec->capacity * sizeof(*vec->data));
+    assert(vec->data);
 }
 
 void
 ds_vector_free(struct DSVector *vec)
 {
-    int32_t i;
+    size_t i;
 
     for (i = 0; i < vec->size; ++i)
         free(vec->data[i]);
 
-    free(vec->data);
-    free(vec);
+    ds_vector_free_no_data(vec);
 }
 
 void 
 ds_vector_free_no_data(struct DSVector *vec)
 {
-    free(vec->data);
+    ds_vector_release(vec);
     free(vec);
 }
 
@@ -62,11 +279,10 @@ struct DSVector *
 ds_vector_copy(struct DSVector *vec)
 {
     struct DSVector *copy;
-    int32_t i;
 
     copy = ds_vector_create_capacity(vec->capacity);
-    for (i = 0; i < vec->size; ++i)
-        ds_vector_append(copy, vec->data[i]);
+    ds_vector_set_growth(copy, vec->expand_ratio, vec->expand_step);
+    ds_vector_extend(copy, vec->data, vec->size);
 
     return copy;
 }
@@ -74,44 +290,75 @@ ds_vector_copy(struct DSVector *vec)
 void
 ds_vector_append(struct DSVector *vec, void* data)
 {
-    ds_vector_maybe_expand(vec);
+    ds_vector_maybe_expand(vec, 1);
     vec->data[vec->size++] = data;
 }
 
 void
-ds_vector_insert(struct DSVector *vec, void* data, int32_t index)
+ds_vector_extend(struct DSVector *vec, void **data, size_t count)
+{
+    if (count == 0)
+        return;
+
+    ds_vector_maybe_expand(vec, count);
+    memcpy(vec->data + vec->size, data, count * sizeof(*vec->data));
+    vec->size += count;
+}
+
+void
+ds_vector_insert(struct DSVector *vec, void* data, size_t index)
 {
-    int32_t i;
+    ds_vector_insert_range(vec, &data, 1, index);
+}
 
+void
+ds_vector_insert_range(struct DSVector *vec, void **data, size_t count,
+                       size_t index)
+{
     /* the index is allowed to be vec->size */
-    if (index > vec->size)
+    if (index > vec->size || count == 0)
         return;
 
-    ds_vector_maybe_expand(vec);
+    ds_vector_maybe_expand(vec, count);
 
-    for (i = vec->size - 1; i >= index && i < (i + 1); --i)
-        vec->data[i + 1] = vec->data[i];
+    memmove(vec->data + index + count, vec->data + index,
+            (vec->size - index) * sizeof(*vec->data));
+    memcpy(vec->data + index, data, count * sizeof(*vec->data));
 
-    vec->data[index] = data;
+    vec->size += count;
+}
 
-    ++vec->size;
+void
+ds_vector_remove(struct DSVector *vec, size_t index)
+{
+    ds_vector_remove_range(vec, index, 1);
 }
 
 void
-ds_vector_remove(struct DSVector *vec, int32_t index)
+ds_vector_remove_range(struct DSVector *vec, size_t index, size_t count)
 {
-    int32_t i;
+    if (index >= vec->size || count == 0)
+        return;
+
+    if (count > vec->size - index)
+        count = vec->size - index;
 
+    memmove(vec->data + index, vec->data + index + count,
+            (vec->size - index - count) * sizeof(*vec->data));
+    vec->size -= count;
+}
+
+void
+ds_vector_swap_remove(struct DSVector *vec, size_t index)
+{
     if (index >= vec->size)
         return;
 
-    --vec->size;
-    for (i = index; i < vec->size; ++i)
-        vec->data[i] = vec->data[i + 1];
+    vec->data[index] = vec->data[--vec->size];
 }
 
 void *
-ds_vector_get(struct DSVector *vec, int32_t index)
+ds_vector_get(struct DSVector *vec, size_t index)
 {
     if (index >= vec->size)
         return NULL;
@@ -120,7 +367,7 @@ ds_vector_get(struct DSVector *vec, int32_t index)
 }
 
 void
-ds_vector_set(struct DSVector *vec, void* data, int32_t index)
+ds_vector_set(struct DSVector *vec, void* data, size_t index)
 {
     if (index >= vec->size)
         return;
@@ -129,7 +376,7 @@ ds_vector_set(struct DSVector *vec, void* data, int32_t index)
 }
 
 void
-ds_vector_swap(struct DSVector *vec, int32_t i, int32_t j)
+ds_vector_swap(struct DSVector *vec, size_t i, size_t j)
 {
     void *temp;
 
@@ -144,90 +391,837 @@ ds_vector_swap(struct DSVector *vec, int32_t i, int32_t j)
 void
 ds_vector_map(struct DSVector *vec, void (func)(void*))
 {
-    int32_t i;
+    size_t i;
 
     for (i = 0; i < vec->size; ++i)
         func(vec->data[i]);
 }
 
-int32_t
+void
+ds_vector_parallel_map(struct DSVector *vec, void (func)(void*, void*),
+                       void *ctx, int32_t nthreads)
+{
+    struct DSVectorBlockJob *blocks;
+    size_t count, i;
+
+    blocks = ds_vector_blocks(vec, &count, ctx);
+    for (i = 0; i < count; ++i)
+        blocks[i].map = func;
+
+    ds_vector_parallel_run(blocks, count, sizeof(*blocks), ds_vector_map_job,
+                           ds_vector_threads(nthreads));
+    free(blocks);
+}
+
+void *
+ds_vector_parallel_reduce(struct DSVector *vec, void *(init)(void*),
+                          void *(reduce)(void*, void*, void*),
+                          void *(combine)(void*, void*, void*),
+                          void *ctx, int32_t nthreads)
+{
+    struct DSVectorBlockJob *blocks;
+    size_t count, i;
+    void *acc;
+
+    if (vec->size == 0)
+        return init(ctx);
+
+    blocks = ds_vector_blocks(vec, &count, ctx);
+    for (i = 0; i < count; ++i) {
+        blocks[i].init = init;
+        blocks[i].reduce = reduce;
+    }
+
+    ds_vector_parallel_run(blocks, count, sizeof(*blocks),
+                           ds_vector_reduce_job, ds_vector_threads(nthreads));
+
+    acc = blocks[0].result;
+    for (i = 1; i < count; ++i)
+        acc = combine(acc, blocks[i].result, ctx);
+
+    free(blocks);
+    return acc;
+}
+
+size_t
 ds_vector_find(struct DSVector *vec, void* needle,
                int32_t (compare)(void*, void*))
 {
-    int32_t i;
+    size_t i;
 
     for (i = 0; i < vec->size; ++i)
         if (compare(needle, vec->data[i]) == 0)
             return i;
 
-    return -1;
+    return (size_t) -1;
+}
+
+size_t
+ds_vector_find_ptr(struct DSVector *vec, void *needle)
+{
+#ifdef DS_VECTOR_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return ds_vector_find_ptr_avx2(vec->data, vec->size, needle);
+
+    return ds_vector_find_ptr_sse2(vec->data, vec->size, needle);
+#else
+    return ds_vector_find_ptr_scalar(vec->data, vec->size, 0, needle);
+#endif
+}
+
+size_t
+ds_vector_bsearch(struct DSVector *vec, void *needle,
+                  int32_t (compare)(void*, void*))
+{
+    size_t lo, hi, mid;
+    int32_t cmp;
+
+    lo = 0;
+    hi = vec->size;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = compare(needle, vec->data[mid]);
+
+        if (cmp == 0)
+            return mid;
+        else if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return (size_t) -1;
+}
+
+size_t
+ds_vector_lower_bound(struct DSVector *vec, void *needle,
+                      int32_t (compare)(void*, void*))
+{
+    size_t lo, hi, mid;
+
+    lo = 0;
+    hi = vec->size;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+
+        if (compare(needle, vec->data[mid]) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Searches data[i..size) one element at a time. Also finishes the tails
+ * the vectorized searches leave behind. */
+static size_t
+ds_vector_find_ptr_scalar(void **data, size_t size, size_t i, void *needle)
+{
+    for (; i < size; ++i)
+        if (data[i] == needle)
+            return i;
+
+    return (size_t) -1;
+}
+
+#ifdef DS_VECTOR_SIMD
+static size_t
+ds_vector_find_ptr_sse2(void **data, size_t size, void *needle)
+{
+    __m128i key, lo, hi;
+    size_t i;
+    int mask;
+
+    /* SSE2 has no 64 bit compare, so compare 32 bit halves and require
+     * both halves of a pointer to match. */
+    key = _mm_set1_epi64x((intptr_t) needle);
+
+    for (i = 0; i + 4 <= size; i += 4) {
+        lo = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) (data + i)), key);
+        hi = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) (data + i + 2)), key);
+
+        mask = _mm_movemask_ps(_mm_castsi128_ps(lo))
+             | _mm_movemask_ps(_mm_castsi128_ps(hi)) << 4;
+        mask &= mask >> 1;
+
+        if (mask & 0x55) {
+            mask &= 0x55;
+            return i + (size_t) (__builtin_ctz(mask) / 2);
+        }
+    }
+
+    return ds_vector_find_ptr_scalar(data, size, i, needle);
+}
+
+__attribute__((target("avx2")))
+static size_t
+ds_vector_find_ptr_avx2(void **data, size_t size, void *needle)
+{
+    __m256i key, a, b, any;
+    size_t i;
+    int mask;
+
+    key = _mm256_set1_epi64x((intptr_t) needle);
+
+    for (i = 0; i + 8 <= size; i += 8) {
+        a = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i*) (data + i)),
+                               key);
+        b = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i*) (data + i + 4)),
+                               key);
+
+        any = _mm256_or_si256(a, b);
+
+        if (!_mm256_testz_si256(any, any)) {
+            mask = _mm256_movemask_pd(_mm256_castsi256_pd(a))
+                 | _mm256_movemask_pd(_mm256_castsi256_pd(b)) << 4;
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+
+    return ds_vector_find_ptr_scalar(data, size, i, needle);
 }
+#endif
 
 /** 
  * I've implemented my own Quicksort (based on the Wikipedia entry on
  * Quicksort) because I didn't like how the standard library's version
  * of qsort forces you to define the comparison function. (Namely, that
  * the arguments are void** instead of void*.)
+ *
+ * It is an introsort: a three-way partitioning quicksort that falls back
+ * to heapsort when it recurses too deep, and to insertion sort on short
+ * runs. See ds_vector_introsort.
  */
 void
 ds_vector_sort(struct DSVector *vec, int32_t (compare)(void*, void*))
 {
-    ds_vector_quicksort(vec, 0, vec->size - 1, compare);
+    struct DSVectorCompare plain;
+
+    plain.compare = compare;
+    ds_vector_sort_r(vec, ds_vector_compare_plain, &plain);
+}
+
+void
+ds_vector_sort_r(struct DSVector *vec, int32_t (compare)(void*, void*, void*),
+                 void *ctx)
+{
+    if (vec->size > 1)
+        ds_vector_quicksort(vec, 0, vec->size - 1, compare, ctx);
+}
+
+/**
+ * An LSD radix sort over (key, element) pairs, one byte per pass.
+ * Passes where every key has the same byte are skipped, so small keys
+ * only cost as many passes as they have significant bytes.
+ */
+void
+ds_vector_sort_by_key(struct DSVector *vec, uint64_t (key)(void*))
+{
+    struct DSVectorKeyed *keyed, *temp, *swap;
+    size_t (*counts)[256], offset, count;
+    size_t i, pass;
+
+    if (vec->size < 2)
+        return;
+
+    keyed = malloc(vec->size * sizeof(*keyed));
+    assert(keyed);
+    temp = malloc(vec->size * sizeof(*temp));
+    assert(temp);
+    counts = calloc(8, sizeof(*counts));
+    assert(counts);
+
+    for (i = 0; i < vec->size; ++i) {
+        keyed[i].key = key(vec->data[i]);
+        keyed[i].data = vec->data[i];
+
+        for (pass = 0; pass < 8; ++pass)
+            ++counts[pass][(keyed[i].key >> (8 * pass)) & 0xff];
+    }
+
+    for (pass = 0; pass < 8; ++pass) {
+        int shift;
+
+        shift = 8 * pass;
+        if (counts[pass][(keyed[0].key >> shift) & 0xff] == vec->size)
+            continue;
+
+        offset = 0;
+        for (i = 0; i < 256; ++i) {
+            count = counts[pass][i];
+            counts[pass][i] = offset;
+            offset += count;
+        }
+
+        for (i = 0; i < vec->size; ++i)
+            temp[counts[pass][(keyed[i].key >> shift) & 0xff]++] = keyed[i];
+
+        swap = keyed;
+        keyed = temp;
+        temp = swap;
+    }
+
+    for (i = 0; i < vec->size; ++i)
+        vec->data[i] = keyed[i].data;
+
+    free(counts);
+    free(temp);
+    free(keyed);
+}
+
+static int32_t
+ds_vector_compare_plain(void *a, void *b, void *ctx)
+{
+    return ((struct DSVectorCompare*) ctx)->compare(a, b);
 }
 
 static void
-ds_vector_quicksort(struct DSVector *vec, int32_t left, int32_t right,
-                    int32_t (compare)(void *, void*))
+ds_vector_quicksort(struct DSVector *vec, size_t left, size_t right,
+                    int32_t (compare)(void*, void*, void*), void *ctx)
 {
-    int32_t pivot;
+    size_t depth, n;
 
     if (left >= right)
         return;
 
-    pivot = (left + right) / 2;
-    pivot = ds_vector_partition(vec, left, right, pivot, compare);
+    depth = 0;
+    for (n = right - left + 1; n > 1; n >>= 1)
+        depth += 2;
 
-    ds_vector_quicksort(vec, left, pivot - 1, compare);
-    ds_vector_quicksort(vec, pivot + 1, right, compare);
+    ds_vector_introsort(vec, left, right, depth, compare, ctx);
 }
 
-static int32_t
-ds_vector_partition(struct DSVector *vec, int32_t left, int32_t right,
-                    int32_t pivot,
-                    int32_t (compare)(void *, void*))
+/**
+ * Quicksorts the run [left, right] with a three-way partition, so every
+ * element equal to the pivot is placed in one pass and never looked at
+ * again. That keeps runs with few distinct keys at O(n log n) instead of
+ * O(n^2). Only the smaller side is recursed into, and once 'depth'
+ * partitions have been spent the rest of the run is heapsorted, which
+ * bounds both the stack and the worst case.
+ */
+static void
+ds_vector_introsort(struct DSVector *vec, size_t left, size_t right,
+                    size_t depth,
+                    int32_t (compare)(void*, void*, void*), void *ctx)
 {
-    void *pivot_val, *temp;
-    int32_t store_ind, i;
+    size_t pivot, lt, gt;
 
-    pivot_val = vec->data[pivot];
-    vec->data[pivot] = vec->data[right];
-    vec->data[right] = pivot_val;
+    while (left < right) {
+        if (right - left < DS_VECTOR_INSERTION_SORT) {
+            ds_vector_insertion_sort(vec, left, right, compare, ctx);
+            return;
+        }
+        if (depth == 0) {
+            ds_vector_heapsort(vec, left, right, compare, ctx);
+            return;
+        }
+        --depth;
 
-    store_ind = left;
+        pivot = ds_vector_median(vec, left, right, compare, ctx);
+        ds_vector_partition(vec, left, right, pivot, &lt, &gt, compare, ctx);
 
-    for (i = left; i < right; ++i)
-        if (compare(vec->data[i], pivot_val) < 0) {
-            temp = vec->data[i];
-            vec->data[i] = vec->data[store_ind];
-            vec->data[store_ind] = temp;
-            ++store_ind;
+        if (lt - left < right - gt) {
+            if (lt > left)
+                ds_vector_introsort(vec, left, lt - 1, depth, compare, ctx);
+            left = gt + 1;
+        } else {
+            if (gt < right)
+                ds_vector_introsort(vec, gt + 1, right, depth, compare, ctx);
+            if (lt == left)
+                return;
+            right = lt - 1;
         }
+    }
+}
+
+/* Returns the index of the median of the first, middle and last elements
+ * of [left, right]. */
+static size_t
+ds_vector_median(struct DSVector *vec, size_t left, size_t right,
+                 int32_t (compare)(void*, void*, void*), void *ctx)
+{
+    size_t mid;
+    void **d;
 
-    temp = vec->data[store_ind];
-    vec->data[store_ind] = vec->data[right];
-    vec->data[right] = temp;
+    d = vec->data;
+    mid = left + (right - left) / 2;
 
-    return store_ind;
+    if (compare(d[left], d[mid], ctx) < 0) {
+        if (compare(d[mid], d[right], ctx) < 0)
+            return mid;
+        return compare(d[left], d[right], ctx) < 0 ? right : left;
+    }
+    if (compare(d[left], d[right], ctx) < 0)
+        return left;
+    return compare(d[mid], d[right], ctx) < 0 ? right : mid;
 }
 
 static void
-ds_vector_maybe_expand(struct DSVector *vec)
+ds_vector_insertion_sort(struct DSVector *vec, size_t left, size_t right,
+                         int32_t (compare)(void*, void*, void*), void *ctx)
 {
-    if (vec->size < vec->capacity)
+    void *val;
+    size_t i, j;
+
+    for (i = left + 1; i <= right; ++i) {
+        val = vec->data[i];
+        for (j = i; j > left && compare(val, vec->data[j - 1], ctx) < 0; --j)
+            vec->data[j] = vec->data[j - 1];
+        vec->data[j] = val;
+    }
+}
+
+static void
+ds_vector_heapsort(struct DSVector *vec, size_t left, size_t right,
+                   int32_t (compare)(void*, void*, void*), void *ctx)
+{
+    void **heap, *temp;
+    size_t size, i;
+
+    heap = vec->data + left;
+    size = right - left + 1;
+
+    for (i = size / 2; i > 0; --i)
+        ds_vector_sift_down(heap, i - 1, size, compare, ctx);
+
+    while (size > 1) {
+        --size;
+        temp = heap[0];
+        heap[0] = heap[size];
+        heap[size] = temp;
+        ds_vector_sift_down(heap, 0, size, compare, ctx);
+    }
+}
+
+static void
+ds_vector_sift_down(void **heap, size_t root, size_t size,
+                    int32_t (compare)(void*, void*, void*), void *ctx)
+{
+    void *val;
+    size_t child;
+
+    val = heap[root];
+    while ((child = 2 * root + 1) < size) {
+        if (child + 1 < size && compare(heap[child], heap[child + 1], ctx) < 0)
+            ++child;
+        if (compare(val, heap[child], ctx) >= 0)
+            break;
+        heap[root] = heap[child];
+        root = child;
+    }
+    heap[root] = val;
+}
+
+/**
+ * The parallel sort quicksorts one run per thread and then merges
+ * neighbouring runs until one is left. Instead of giving each merge to a
+ * single thread (which would leave all but one thread idle in the last
+ * round), every merge is cut into pieces of equal output length by binary
+ * searching for the split point in both inputs ("merge path"), and the
+ * pieces are spread over all threads.
+ */
+void
+ds_vector_sort_parallel(struct DSVector *vec, int32_t (compare)(void*, void*),
+                        int32_t nthreads)
+{
+    struct DSVectorSortJob *sorts;
+    struct DSVectorMergeJob *merges;
+    size_t *bounds, runs, i, p, k;
+    void **src, **dst, **temp;
+
+    nthreads = ds_vector_threads(nthreads);
+    if ((size_t) nthreads > vec->size / DS_VECTOR_PARALLEL_MIN)
+        nthreads = (int32_t) (vec->size / DS_VECTOR_PARALLEL_MIN);
+    if (nthreads < 2) {
+        ds_vector_sort(vec, compare);
         return;
+    }
 
-    vec->capacity *= DS_VECTOR_EXPAND_RATIO;
-    vec->data = realloc(vec->data, vec->capacity * sizeof(vec->data));
-    assert(vec->data);
+    runs = nthreads;
+    bounds = malloc((runs + 1) * sizeof(*bounds));
+    assert(bounds);
+    sorts = malloc(runs * sizeof(*sorts));
+    assert(sorts);
+
+    for (i = 0; i <= runs; ++i)
+        bounds[i] = vec->size * i / runs;
+
+    for (i = 0; i < runs; ++i) {
+        sorts[i].vec = vec;
+        sorts[i].left = bounds[i];
+        sorts[i].right = bounds[i + 1] - 1;
+        sorts[i].compare = compare;
+    }
+    ds_vector_parallel_run(sorts, runs, sizeof(*sorts), ds_vector_sort_job,
+                           nthreads);
+    free(sorts);
+
+    /* There are never more merge pieces than threads, plus one for an odd
+     * run that is carried over to the next round. */
+    merges = malloc((nthreads + 1) * sizeof(*merges));
+    assert(merges);
+    dst = malloc(vec->size * sizeof(*dst));
+    assert(dst);
+    src = vec->data;
+
+    while (runs > 1) {
+        size_t pairs, pieces, njobs;
+
+        pairs = runs / 2;
+        pieces = nthreads / pairs;
+        njobs = 0;
+
+        for (p = 0; p < pairs; ++p) {
+            void **a, **b, **out;
+            size_t alen, blen, total;
+
+            a = src + bounds[2 * p];
+            b = src + bounds[2 * p + 1];
+            out = dst + bounds[2 * p];
+            alen = bounds[2 * p + 1] - bounds[2 * p];
+            blen = bounds[2 * p + 2] - bounds[2 * p + 1];
+            total = alen + blen;
+
+            for (k = 0; k < pieces; ++k) {
+                size_t d0, d1, i0, i1;
+
+                d0 = total * k / pieces;
+                d1 = total * (k + 1) / pieces;
+                i0 = ds_vector_merge_split(a, alen, b, blen, d0, compare);
+                i1 = ds_vector_merge_split(a, alen, b, blen, d1, compare);
+
+                merges[njobs].a = a + i0;
+                merges[njobs].alen = i1 - i0;
+                merges[njobs].b = b + (d0 - i0);
+                merges[njobs].blen = (d1 - i1) - (d0 - i0);
+                merges[njobs].out = out + d0;
+                merges[njobs].compare = compare;
+                ++njobs;
+            }
+        }
+
+        /* an odd run out just gets copied over */
+        if (runs % 2 == 1) {
+            merges[njobs].a = src + bounds[runs - 1];
+            merges[njobs].alen = bounds[runs] - bounds[runs - 1];
+            merges[njobs].b = NULL;
+            merges[njobs].blen = 0;
+            merges[njobs].out = dst + bounds[runs - 1];
+            merges[njobs].compare = compare;
+            ++njobs;
+        }
+
+        ds_vector_parallel_run(merges, njobs, sizeof(*merges),
+                               ds_vector_merge_job, nthreads);
+
+        for (i = 0; i <= runs / 2; ++i)
+            bounds[i] = bounds[2 * i];
+        if (runs % 2 == 1)
+            bounds[runs / 2 + 1] = bounds[runs];
+        runs = (runs + 1) / 2;
+
+        temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    /* 'src' always holds the most recently merged data */
+    if (src != vec->data) {
+        memcpy(vec->data, src, vec->size * sizeof(*vec->data));
+        dst = src;
+    }
+
+    free(dst);
+    free(merges);
+    free(bounds);
+}
+
+/* Splits [left, right] around the element at 'pivot' into the elements
+ * less than it, [left, *lt), equal to it, [*lt, *gt], and greater than it,
+ * (*gt, right].
+ *
+ * This is the Bentley-McIlroy partition: two indices close in from both
+ * ends like Hoare's partition, so elements already on the right side are
+ * not moved, and elements equal to the pivot are parked at either end and
+ * swapped into the middle at the end. */
+static void
+ds_vector_partition(struct DSVector *vec, size_t left, size_t right,
+                    size_t pivot, size_t *lt, size_t *gt,
+                    int32_t (compare)(void*, void*, void*), void *ctx)
+{
+    void **d, *pivot_val, *temp;
+    size_t a, b, c, e, n, i, less, greater;
+    int32_t cmp;
+
+    d = vec->data;
+    DS_VECTOR_SWAP(d, left, pivot, temp);
+    pivot_val = d[left];
+
+    /* [left, a) and (e, right] equal the pivot, [a, b) is less than it
+     * and (c, e] greater. [b, c] is still to be looked at. */
+    a = b = left + 1;
+    c = e = right;
+    for (;;) {
+        while (b <= c && (cmp = compare(d[b], pivot_val, ctx)) <= 0) {
+            if (cmp == 0) {
+                DS_VECTOR_SWAP(d, a, b, temp);
+                ++a;
+            }
+            ++b;
+        }
+        while (b <= c && (cmp = compare(d[c], pivot_val, ctx)) >= 0) {
+            if (cmp == 0) {
+                DS_VECTOR_SWAP(d, c, e, temp);
+                --e;
+            }
+            --c;
+        }
+        if (b > c)
+            break;
+        DS_VECTOR_SWAP(d, b, c, temp);
+        ++b;
+        --c;
+    }
+
+    less = b - a;
+    greater = e - c;
+
+    /* Move the equal elements from both ends into the middle. */
+    n = a - left < less ? a - left : less;
+    for (i = 0; i < n; ++i)
+        DS_VECTOR_SWAP(d, left + i, b - n + i, temp);
+    n = right - e < greater ? right - e : greater;
+    for (i = 0; i < n; ++i)
+        DS_VECTOR_SWAP(d, b + i, right - n + 1 + i, temp);
+
+    *lt = left + less;
+    *gt = right - greater;
+}
+
+/* Returns the number of elements to take from 'a' when the first 'diag'
+ * elements of merging 'a' and 'b' are taken. Ties go to 'a'. */
+static size_t
+ds_vector_merge_split(void **a, size_t alen, void **b, size_t blen,
+                      size_t diag, int32_t (compare)(void*, void*))
+{
+    size_t lo, hi, mid;
+
+    lo = diag > blen ? diag - blen : 0;
+    hi = diag < alen ? diag : alen;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (compare(b[diag - mid - 1], a[mid]) >= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static void
+ds_vector_merge_job(void *vjob)
+{
+    struct DSVectorMergeJob *job;
+    size_t i, j, k;
+
+    job = (struct DSVectorMergeJob*) vjob;
+    i = j = k = 0;
+
+    while (i < job->alen && j < job->blen) {
+        if (job->compare(job->a[i], job->b[j]) <= 0)
+            job->out[k++] = job->a[i++];
+        else
+            job->out[k++] = job->b[j++];
+    }
+
+    memcpy(job->out + k, job->a + i, (job->alen - i) * sizeof(*job->out));
+    k += job->alen - i;
+    if (j < job->blen)
+        memcpy(job->out + k, job->b + j, (job->blen - j) * sizeof(*job->out));
+}
+
+/* Cuts the vector into blocks of DS_VECTOR_PARALLEL_BLOCK elements.
+ * Since the threads only read the data array, there is no false sharing
+ * to worry about where blocks meet. */
+static struct DSVectorBlockJob *
+ds_vector_blocks(struct DSVector *vec, size_t *count, void *ctx)
+{
+    struct DSVectorBlockJob *blocks;
+    size_t i;
+
+    *count = (vec->size + DS_VECTOR_PARALLEL_BLOCK - 1)
+             / DS_VECTOR_PARALLEL_BLOCK;
+
+    blocks = calloc(*count > 0 ? *count : 1, sizeof(*blocks));
+    assert(blocks);
+
+    for (i = 0; i < *count; ++i) {
+        blocks[i].data = vec->data;
+        blocks[i].start = i * DS_VECTOR_PARALLEL_BLOCK;
+        blocks[i].end = blocks[i].start + DS_VECTOR_PARALLEL_BLOCK;
+        if (blocks[i].end > vec->size)
+            blocks[i].end = vec->size;
+        blocks[i].ctx = ctx;
+    }
+
+    return blocks;
+}
+
+static void
+ds_vector_map_job(void *vjob)
+{
+    struct DSVectorBlockJob *job;
+    size_t i;
+
+    job = (struct DSVectorBlockJob*) vjob;
+    for (i = job->start; i < job->end; ++i)
+        job->map(job->data[i], job->ctx);
+}
+
+static void
+ds_vector_reduce_job(void *vjob)
+{
+    struct DSVectorBlockJob *job;
+    size_t i;
+
+    job = (struct DSVectorBlockJob*) vjob;
+    job->result = job->init(job->ctx);
+    for (i = job->start; i < job->end; ++i)
+        job->result = job->reduce(job->result, job->data[i], job->ctx);
+}
+
+static void
+ds_vector_sort_job(void *vjob)
+{
+    struct DSVectorSortJob *job;
+    struct DSVectorCompare plain;
+
+    job = (struct DSVectorSortJob*) vjob;
+    plain.compare = job->compare;
+    ds_vector_quicksort(job->vec, job->left, job->right,
+                        ds_vector_compare_plain, &plain);
+}
+
+/* Resolves a requested number of threads: anything below 1 means one
+ * thread per online CPU. */
+static int32_t
+ds_vector_threads(int32_t nthreads)
+{
+    long cpus;
+
+    if (nthreads > 0)
+        return nthreads;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int32_t) cpus : 1;
+}
+
+/* Runs 'work' on each of the 'count' jobs using at most 'nthreads' threads
+ * (the calling thread included) and returns once every job has finished.
+ * If a thread can't be started, the remaining threads pick up its share.
+ * The threads are started and joined here on every call: a pool would need
+ * global state that outlives the call, which nothing else in libds has. */
+static void
+ds_vector_parallel_run(void *jobs, size_t count, size_t job_size,
+                       void (work)(void*), int32_t nthreads)
+{
+    struct DSVectorJobs set;
+    pthread_t *threads;
+    int32_t i, started;
+
+    set.jobs = (char*) jobs;
+    set.job_size = job_size;
+    set.count = count;
+    set.next = 0;
+    set.work = work;
+    pthread_mutex_init(&set.lock, NULL);
+
+    if ((size_t) nthreads > count)
+        nthreads = (int32_t) count;
+
+    threads = malloc((nthreads > 1 ? nthreads - 1 : 1) * sizeof(*threads));
+    assert(threads);
+
+    started = 0;
+    for (i = 0; i < nthreads - 1; ++i)
+        if (pthread_create(&threads[started], NULL,
+                           ds_vector_parallel_worker, &set) == 0)
+            ++started;
+
+    ds_vector_parallel_worker(&set);
+
+    for (i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&set.lock);
+}
+
+static void *
+ds_vector_parallel_worker(void *vset)
+{
+    struct DSVectorJobs *set;
+    size_t i;
+
+    set = (struct DSVectorJobs*) vset;
+    for (;;) {
+        pthread_mutex_lock(&set->lock);
+        i = set->next++;
+        pthread_mutex_unlock(&set->lock);
+
+        if (i >= set->count)
+            break;
+
+        set->work(set->jobs + i * set->job_size);
+    }
+
+    return NULL;
+}
+
+static void
+ds_vector_maybe_expand(struct DSVector *vec, size_t count)
+{
+    size_t capacity, step, max, rounded;
+    double grown;
+    long page;
+
+    if (vec->capacity - vec->size >= count)
+        return;
+
+    /* the largest capacity whose size in bytes fits in a size_t */
+    max = SIZE_MAX / sizeof(*vec->data);
+    if (count > max - vec->size) {
+        fprintf(stderr, "Vector capacity overflow: %lu + %lu elements.\n",
+                (unsigned long) vec->size, (unsigned long) count);
+        exit(1);
+    }
+
+    grown = vec->capacity * (double) vec->expand_ratio;
+    capacity = grown < (double) max ? (size_t) grown : max;
+
+    step = vec->expand_step / sizeof(*vec->data);
+    if (step > 0 && capacity - vec->capacity > step)
+        capacity = vec->capacity + step;
+
+    /* Small capacities don't grow at all when multiplied by the ratio,
+     * and a large range may need more than one step's worth anyway. */
+    if (capacity < DS_VECTOR_BASE_CAPACITY)
+        capacity = DS_VECTOR_BASE_CAPACITY;
+    if (capacity < vec->size + count)
+        capacity = vec->size + count;
+
+    /* stepped growth hands out whole pages */
+    if (step > 0 && capacity >= step) {
+        page = sysconf(_SC_PAGESIZE) / sizeof(*vec->data);
+        if (page > 0) {
+            rounded = (capacity + (size_t) page - 1) / page * page;
+            capacity = rounded <= max ? rounded : capacity;
+        }
+    }
+
+    ds_vector_reserve(vec, capacity);
 }
 
@@ -2,20 +2,45 @@
 #define __LIBDS_VECTOR_H__
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* The number of elements a vector can hold inside its own struct before
+ * it needs to allocate memory for them. (This is a #define since it sizes
+ * an array.) */
+#define DS_VECTOR_INLINE_CAPACITY 4
+
 /* some private constants for vector tuning */
-static const int32_t DS_VECTOR_BASE_CAPACITY = 10;
+static const size_t DS_VECTOR_BASE_CAPACITY = 10;
 static const float DS_VECTOR_EXPAND_RATIO = 1.5;
 
+/* vectors smaller than this are always sorted on the calling thread */
+static const size_t DS_VECTOR_PARALLEL_MIN = 16384;
+
+/* the number of elements in each block handed to a thread by the parallel
+ * map and reduce (a multiple of a 64 byte cache line of pointers) */
+static const size_t DS_VECTOR_PARALLEL_BLOCK = 4096;
+
 struct DSVector {
-    int32_t size;
-    int32_t capacity;
+    size_t size;
+    size_t capacity;
+
+    /* Points to 'inline_data' while the vector is small enough, and to
+     * memory on the heap after that. */
     void** data;
+
+    /* The growth policy. See ds_vector_set_growth. */
+    float expand_ratio;
+    size_t expand_step;
+
+    void* inline_data[DS_VECTOR_INLINE_CAPACITY];
 };
 
 /**
- * Creates a vector with DS_VECTOR_BASE_CAPACITY.
+ * Creates an empty vector. Its first DS_VECTOR_INLINE_CAPACITY elements
+ * are stored inside the vector itself, so only the vector is allocated
+ * until it grows past that. (When it does, it allocates room for at least
+ * DS_VECTOR_BASE_CAPACITY elements.)
  * ds_vector_free or ds_vector_free_no_data will need to be called
  * when done with the vector to avoid memory leaks.
  */
@@ -27,7 +52,66 @@ ds_vector_create();
  * (N.B. This vector will still automatically increase in size if necessary.)
  */
 struct DSVector *
-ds_vector_create_capacity(int32_t capacity);
+ds_vector_create_capacity(size_t capacity);
+
+/**
+ * Sets up a vector in memory provided by the caller, e.g., a DSVector
+ * embedded by value in another struct or on the stack. Nothing is
+ * allocated until the vector grows past DS_VECTOR_INLINE_CAPACITY.
+ * ds_vector_release must be called when done with the vector. Do not use
+ * ds_vector_free or ds_vector_free_no_data on such a vector.
+ *
+ * N.B. A small vector points into itself, so an initialized vector must
+ * not be copied or moved with assignment or memcpy. Use ds_vector_copy.
+ */
+void
+ds_vector_init(struct DSVector *vec);
+
+/**
+ * Like ds_vector_init, but with room for at least 'capacity' elements.
+ */
+void
+ds_vector_init_capacity(struct DSVector *vec, size_t capacity);
+
+/**
+ * Free's the memory a vector set up with ds_vector_init allocated for its
+ * elements. Neither the vector itself nor the data is freed.
+ * The vector is left empty and can be used again.
+ */
+void
+ds_vector_release(struct DSVector *vec);
+
+/**
+ * Sets how a vector grows when it runs out of capacity.
+ * The capacity is multiplied by 'ratio' (which must be greater than 1),
+ * but once that would add more than 'step' bytes, it instead grows by
+ * 'step' bytes at a time, rounded up to whole pages.
+ * A 'step' of 0 means the vector always grows by 'ratio'.
+ *
+ * Stepped growth bounds the slack in huge vectors. (With glibc, blocks
+ * that large get their own mapping, and realloc grows them with mremap
+ * instead of copying the data, so frequent small steps stay cheap.)
+ *
+ * New vectors grow by DS_VECTOR_EXPAND_RATIO with no step.
+ */
+void
+ds_vector_set_growth(struct DSVector *vec, float ratio, size_t step);
+
+/**
+ * Makes sure the vector can hold at least 'capacity' elements without
+ * growing again. Call this before appending a known number of elements.
+ * Never shrinks the vector.
+ */
+void
+ds_vector_reserve(struct DSVector *vec, size_t capacity);
+
+/**
+ * Shrinks the vector's capacity to its size, returning the rest of its
+ * memory to the allocator. A vector that fits in DS_VECTOR_INLINE_CAPACITY
+ * moves its elements back inside itself and frees its heap memory.
+ */
+void
+ds_vector_shrink_to_fit(struct DSVector *vec);
 
 /**
  * Free's a vector AND its data.
@@ -55,13 +139,32 @@ ds_vector_copy(struct DSVector *vec);
 void
 ds_vector_append(struct DSVector *vec, void* data);
 
+/**
+ * Adds 'count' elements from 'data' to the end of a vector.
+ * The vector grows at most once, no matter how large 'count' is.
+ * 'data' must not point into the vector itself. (To append one vector
+ * to another, pass 'other->data' and 'other->size'.)
+ */
+void
+ds_vector_extend(struct DSVector *vec, void **data, size_t count);
+
 /**
  * Places an element at index i, and shifts the rest of the vector
  * to the right by one. If index == size of vector, then the element
  * will be appended to the end of the vector.
  */
 void
-ds_vector_insert(struct DSVector *vec, void* data, int32_t index);
+ds_vector_insert(struct DSVector *vec, void* data, size_t index);
+
+/**
+ * Places 'count' elements from 'data' at index i, and shifts the rest of
+ * the vector to the right by 'count' with a single move.
+ * If index == size of vector, the elements are appended.
+ * 'data' must not point into the vector itself.
+ */
+void
+ds_vector_insert_range(struct DSVector *vec, void **data, size_t count,
+                       size_t index);
 
 /**
  * Removes an element from the vector at some index.
@@ -69,26 +172,44 @@ ds_vector_insert(struct DSVector *vec, void* data, int32_t index);
  * Does *NOT* free the data.
  */
 void
-ds_vector_remove(struct DSVector *vec, int32_t index);
+ds_vector_remove(struct DSVector *vec, size_t index);
+
+/**
+ * Removes 'count' elements starting at index, and shifts everything to
+ * the right of them to the left with a single move. If fewer than 'count'
+ * elements follow index, the vector is truncated at index.
+ * Does *NOT* free the data.
+ */
+void
+ds_vector_remove_range(struct DSVector *vec, size_t index, size_t count);
+
+/**
+ * Removes an element from the vector at some index by moving the last
+ * element into its place. Runs in constant time, but does not preserve
+ * the order of the vector.
+ * Does *NOT* free the data.
+ */
+void
+ds_vector_swap_remove(struct DSVector *vec, size_t index);
 
 /**
  * Gets an element at index i from a vector.
  */
 void *
-ds_vector_get(struct DSVector *vec, int32_t index);
+ds_vector_get(struct DSVector *vec, size_t index);
 
 /**
  * Sets an elements at index to data.
  * No data is freed.
  */
 void
-ds_vector_set(struct DSVector *vec, void* data, int32_t index);
+ds_vector_set(struct DSVector *vec, void* data, size_t index);
 
 /**
  * Swaps the data from vector element i to vector element j.
  */
 void
-ds_vector_swap(struct DSVector *vec, int32_t i, int32_t j);
+ds_vector_swap(struct DSVector *vec, size_t i, size_t j);
 
 /**
  * Higher-order function to map func over every element in vector.
@@ -96,6 +217,49 @@ ds_vector_swap(struct DSVector *vec, int32_t i, int32_t j);
 void
 ds_vector_map(struct DSVector *vec, void (func)(void*));
 
+/**
+ * Like ds_vector_map, but 'func' is run from up to 'nthreads' threads at
+ * once, and 'ctx' is passed as its second argument. If 'nthreads' is less
+ * than 1, one thread per online CPU is used.
+ *
+ * The vector is cut into blocks of DS_VECTOR_PARALLEL_BLOCK elements that
+ * are handed out to the threads as they become free. The order in which
+ * 'func' sees elements is unspecified, so it must be safe to call on
+ * different elements concurrently.
+ *
+ * There is no thread pool: every call creates its threads (the calling
+ * thread is one of them) and joins them before returning, which costs
+ * tens of microseconds per thread. A vector of at most one block runs on
+ * the calling thread alone, but for cheap 'func's on vectors of a few
+ * blocks, ds_vector_map may well be faster.
+ */
+void
+ds_vector_parallel_map(struct DSVector *vec, void (func)(void*, void*),
+                       void *ctx, int32_t nthreads);
+
+/**
+ * Reduces the vector to a single value using up to 'nthreads' threads.
+ *
+ * The vector is cut into blocks of DS_VECTOR_PARALLEL_BLOCK elements.
+ * Each block starts with a fresh accumulator from init(ctx) and folds its
+ * elements in order with acc = reduce(acc, element, ctx). The partial
+ * results of all blocks are then folded from left to right with
+ * acc = combine(acc, partial, ctx) on the calling thread. (So 'combine'
+ * should free 'partial' if accumulators are allocated.)
+ *
+ * Blocks only depend on the size of the vector, so the result is the same
+ * for any number of threads, even for operations that are not exactly
+ * associative, like floating point addition.
+ *
+ * An empty vector reduces to init(ctx). Threads are created and joined
+ * on every call, as in ds_vector_parallel_map.
+ */
+void *
+ds_vector_parallel_reduce(struct DSVector *vec, void *(init)(void*),
+                          void *(reduce)(void*, void*, void*),
+                          void *(combine)(void*, void*, void*),
+                          void *ctx, int32_t nthreads);
+
 /**
  * Higher-order function to find the first element in the vector
  * such that compare(needle, element) == 0.
@@ -104,17 +268,89 @@ ds_vector_map(struct DSVector *vec, void (func)(void*));
  *      compare(a, b) = 0 when a = b
  *      compare(a, b) > 0 when a > b
  *
- * Returns an unsigned -1 if needle is not found.
+ * Returns (size_t) -1 if needle is not found.
  */
-int32_t 
+size_t
 ds_vector_find(struct DSVector *vec, void* needle,
                int32_t (compare)(void*, void*));
 
 /**
- * Runs quicksort on the vector in place.
+ * Finds the first element in the vector that is the same pointer as
+ * 'needle', without calling a comparison function. On x86-64 the search
+ * compares 4 (AVX2) or 2 (SSE2) elements per instruction.
+ * Since only the pointer values are compared, this also finds integers
+ * that were stored in the vector by casting them to pointers.
+ *
+ * Returns (size_t) -1 if needle is not found.
+ */
+size_t
+ds_vector_find_ptr(struct DSVector *vec, void *needle);
+
+/**
+ * Binary searches a vector that is sorted with respect to 'compare' for
+ * an element such that compare(needle, element) == 0. If there are several
+ * such elements, any of them may be found.
+ * Runs in O(log n) time.
+ *
+ * Returns (size_t) -1 if needle is not found.
+ */
+size_t
+ds_vector_bsearch(struct DSVector *vec, void *needle,
+                  int32_t (compare)(void*, void*));
+
+/**
+ * Returns the index of the first element in a sorted vector for which
+ * compare(needle, element) <= 0, i.e., the index at which needle could
+ * be inserted while keeping the vector sorted. Returns the size of the
+ * vector if needle is greater than every element.
+ * Runs in O(log n) time.
+ */
+size_t
+ds_vector_lower_bound(struct DSVector *vec, void *needle,
+                      int32_t (compare)(void*, void*));
+
+/**
+ * Runs quicksort on the vector in place. Runs in O(n log n) time, also
+ * when many elements compare equal. The sort is not stable.
  */
 void
 ds_vector_sort(struct DSVector *vec, int32_t (compare)(void*, void*));
 
+/**
+ * Like ds_vector_sort, but 'ctx' is passed as the third argument to every
+ * call of 'compare'. This avoids global state in comparison functions.
+ */
+void
+ds_vector_sort_r(struct DSVector *vec, int32_t (compare)(void*, void*, void*),
+                 void *ctx);
+
+/**
+ * Sorts the vector in place in ascending order of key(element).
+ * 'key' is called exactly once per element; the keys are then radix
+ * sorted, so no comparison function is needed. The sort is stable.
+ *
+ * Signed keys can be sorted by flipping their sign bit, e.g.
+ * (uint64_t) x ^ ((uint64_t) 1 << 63).
+ */
+void
+ds_vector_sort_by_key(struct DSVector *vec, uint64_t (key)(void*));
+
+/**
+ * Sorts the vector in place using up to 'nthreads' threads.
+ * If 'nthreads' is less than 1, one thread per online CPU is used.
+ *
+ * The vector is split into one run per thread, each run is quicksorted
+ * concurrently, and then runs are merged pairwise. Every merge is itself
+ * split between the threads, so all of them stay busy until the end.
+ * An extra buffer of 'size' pointers is allocated while sorting.
+ *
+ * For a total order, the result is identical to ds_vector_sort.
+ * 'compare' must be safe to call from several threads at once. Like the
+ * parallel map, it creates and joins its threads on every call.
+ */
+void
+ds_vector_sort_parallel(struct DSVector *vec, int32_t (compare)(void*, void*),
+                        int32_t nthreads);
+
 #endif
 